@@ -0,0 +1,116 @@
+#include <jerboa.h>
+
+#include <new>
+#include <cmath>
+#include <string>
+
+#include <glew.h>
+
+#include <ParticleSystem/particleSystem.h>
+
+/*
+  libjerboa, the C interface over the core in core/particleSystem.cpp.
+  GL code is linked but never called, draw() is the only way in and
+  the C interface does not expose it, so no context is needed.
+*/
+
+struct jerboa_system {
+  ParticleSystem particles;
+
+  jerboa_system(uint64_t n, const float * initial, float dt, float density, uint64_t seed)
+  : particles(n,initial,dt,density,seed) {}
+};
+
+// a library has no business writing to stdout, failures are kept for jerboa_last_error
+thread_local std::string lastError;
+
+const char * jerboa_last_error(void){
+  return lastError.c_str();
+}
+
+jerboa_system * jerboa_create(uint64_t particles, float dt, float density, uint64_t seed){
+  return jerboa_create_from(particles,nullptr,dt,density,seed);
+}
+
+jerboa_system * jerboa_create_from(uint64_t particles, const float * initial, float dt, float density, uint64_t seed){
+  // written so NaN fails too
+  if (particles == 0 || !(dt > 0.0f) || !std::isfinite(dt) || !(density > 0.0f) || !std::isfinite(density)){
+    lastError = "jerboa_create needs particles, and finite dt and density > 0";
+    return nullptr;
+  }
+  // nothing may unwind into C
+  try {
+    return new jerboa_system(particles,initial,dt,density,seed);
+  }
+  catch (const std::bad_alloc &){
+    lastError = "jerboa_create out of memory for "+std::to_string(particles)+" particles";
+  }
+  catch (...){
+    lastError = "jerboa_create failed";
+  }
+  return nullptr;
+}
+
+void jerboa_destroy(jerboa_system * system){
+  try {
+    delete system;
+  }
+  catch (...){}
+}
+
+int jerboa_step_n(jerboa_system * system, uint64_t steps){
+  try {
+    for (uint64_t s = 0; s < steps; s++){
+      system->particles.step();
+    }
+    return 0;
+  }
+  catch (const std::bad_alloc &){
+    lastError = "jerboa_step_n out of memory";
+  }
+  catch (...){
+    lastError = "jerboa_step_n failed";
+  }
+  return -1;
+}
+
+int jerboa_add_toy(jerboa_system * system, int toy, float x, float y){
+  try {
+    switch (toy){
+      case JERBOA_ATTRACTOR: system->particles.addAttractor(x,y); return 0;
+      case JERBOA_REPELLER: system->particles.addRepeller(x,y); return 0;
+      default: lastError = "jerboa_add_toy unknown toy "+std::to_string(toy); return -1;
+    }
+  }
+  catch (...){
+    lastError = "jerboa toy change failed";
+    return -1;
+  }
+}
+
+int jerboa_remove_toy(jerboa_system * system, float x, float y){
+  try {
+    return system->particles.deleteAttratorRepellor(x,y) ? 1 : 0;
+  }
+  catch (...){
+    lastError = "jerboa toy change failed";
+    return -1;
+  }
+}
+
+jerboa_view jerboa_get_positions_view(jerboa_system * system){
+  jerboa_view view;
+  view.data = system->particles.getState();
+  view.particles = system->particles.size();
+  view.stride = 3;
+  view.step = system->particles.getSteps();
+  return view;
+}
+
+uint64_t jerboa_steps(jerboa_system * system){
+  return system->particles.getSteps();
+}
+
+float jerboa_radius(jerboa_system * system){
+  return system->particles.getRadius();
+}
@@ -0,0 +1,10 @@
+#include <glew.h>
+
+/*
+  The simulation core's one translation unit, compiled once into the
+  object library both Jerboa and libjerboa link.
+*/
+
+#include <CellList/cellList.cpp>
+#include <SharedMemory/sharedFrames.cpp>
+#include <ParticleSystem/particleSystem.cpp>
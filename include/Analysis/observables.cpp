@@ -0,0 +1,294 @@
+#include <Analysis/observables.h>
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+bool writeTable(Table & t, std::string path, bool binary){
+  if (binary){
+    std::ofstream out(path,std::ios::binary);
+    if (!out.is_open()){
+      std::cout << "Could not write: " << path << "\n";
+      return false;
+    }
+    uint64_t rows = t.rows();
+    uint64_t cols = t.columns.size();
+    out.write((const char*)&rows,sizeof(rows));
+    out.write((const char*)&cols,sizeof(cols));
+    for (uint64_t c = 0; c < cols; c++){
+      char name[32];
+      std::memset(name,0,sizeof(name));
+      std::strncpy(name,t.columns[c].c_str(),sizeof(name)-1);
+      out.write(name,sizeof(name));
+    }
+    out.write((const char*)t.data.data(),sizeof(double)*t.data.size());
+    return out.good();
+  }
+
+  std::ofstream out(path);
+  if (!out.is_open()){
+    std::cout << "Could not write: " << path << "\n";
+    return false;
+  }
+  for (uint64_t c = 0; c < t.columns.size(); c++){
+    out << t.columns[c] << (c+1 < t.columns.size() ? "," : "\n");
+  }
+  out << std::setprecision(9);
+  uint64_t cols = t.columns.size();
+  for (uint64_t r = 0; r < t.rows(); r++){
+    for (uint64_t c = 0; c < cols; c++){
+      out << t.data[r*cols+c] << (c+1 < cols ? "," : "\n");
+    }
+  }
+  return out.good();
+}
+
+double frameTime(TrajectoryReader & trajectory){
+  const TrajectoryHeader & h = trajectory.getHeader();
+  return double(h.dt)*double(h.stepsPerFrame);
+}
+
+Table meanSquaredDisplacement(
+  TrajectoryReader & trajectory,
+  uint64_t maxLag,
+  uint64_t originStride,
+  unsigned threads
+){
+  uint64_t F = trajectory.nFrames();
+  uint64_t N = trajectory.nParticles();
+  maxLag = std::min(maxLag,F-1);
+  originStride = std::max(uint64_t(1),originStride);
+
+  std::vector<double> sum(maxLag+1,0.0);
+  std::mutex merge;
+
+  // over particles, so every thread streams the same frames in step
+  parallelFor(0,N,[&](uint64_t first, uint64_t last, unsigned){
+    std::vector<double> local(maxLag+1,0.0);
+    for (uint64_t lag = 1; lag <= maxLag; lag++){
+      for (uint64_t t = 0; t+lag < F; t += originStride){
+        const float * a = trajectory.frame(t);
+        const float * b = trajectory.frame(t+lag);
+        double s = 0.0;
+        for (uint64_t i = first; i < last; i++){
+          double dx = b[i*3]-a[i*3];
+          double dy = b[i*3+1]-a[i*3+1];
+          s += dx*dx+dy*dy;
+        }
+        local[lag] += s;
+      }
+    }
+    std::lock_guard<std::mutex> lock(merge);
+    for (uint64_t lag = 0; lag <= maxLag; lag++){sum[lag] += local[lag];}
+  },threads);
+
+  Table msd({"lag","time","msd"});
+  double tau = frameTime(trajectory);
+  for (uint64_t lag = 0; lag <= maxLag; lag++){
+    uint64_t origins = (F-lag+originStride-1)/originStride;
+    msd.addRow({double(lag),lag*tau,sum[lag]/double(origins*N)});
+  }
+  return msd;
+}
+
+Table velocityAutocorrelation(
+  TrajectoryReader & trajectory,
+  uint64_t maxLag,
+  uint64_t originStride,
+  unsigned threads
+){
+  uint64_t F = trajectory.nFrames();
+  uint64_t N = trajectory.nParticles();
+  Table vacf({"lag","time","vacf","normalised"});
+  if (F < 2){return vacf;}
+
+  // F-1 velocities from F positions
+  uint64_t V = F-1;
+  maxLag = std::min(maxLag,V-1);
+  originStride = std::max(uint64_t(1),originStride);
+  double tau = frameTime(trajectory);
+
+  std::vector<double> sum(maxLag+1,0.0);
+  std::mutex merge;
+
+  parallelFor(0,N,[&](uint64_t first, uint64_t last, unsigned){
+    std::vector<double> local(maxLag+1,0.0);
+    for (uint64_t lag = 0; lag <= maxLag; lag++){
+      for (uint64_t t = 0; t+lag < V; t += originStride){
+        const float * a0 = trajectory.frame(t);
+        const float * a1 = trajectory.frame(t+1);
+        const float * b0 = trajectory.frame(t+lag);
+        const float * b1 = trajectory.frame(t+lag+1);
+        double s = 0.0;
+        for (uint64_t i = first; i < last; i++){
+          double vx = a1[i*3]-a0[i*3];
+          double vy = a1[i*3+1]-a0[i*3+1];
+          double ux = b1[i*3]-b0[i*3];
+          double uy = b1[i*3+1]-b0[i*3+1];
+          s += vx*ux+vy*uy;
+        }
+        local[lag] += s;
+      }
+    }
+    std::lock_guard<std::mutex> lock(merge);
+    for (uint64_t lag = 0; lag <= maxLag; lag++){sum[lag] += local[lag];}
+  },threads);
+
+  double c0 = 0.0;
+  for (uint64_t lag = 0; lag <= maxLag; lag++){
+    uint64_t origins = (V-lag+originStride-1)/originStride;
+    double c = sum[lag]/(double(origins*N)*tau*tau);
+    if (lag == 0){c0 = c;}
+    vacf.addRow({double(lag),lag*tau,c,c0 > 0.0 ? c/c0 : 0.0});
+  }
+  return vacf;
+}
+
+Table radialDistribution(
+  TrajectoryReader & trajectory,
+  float rmax,
+  uint64_t bins,
+  uint64_t frameStride,
+  unsigned threads
+){
+  uint64_t F = trajectory.nFrames();
+  uint64_t N = trajectory.nParticles();
+  frameStride = std::max(uint64_t(1),frameStride);
+  bins = std::max(uint64_t(1),bins);
+  uint64_t nFrames = (F+frameStride-1)/frameStride;
+  double dr = rmax/bins;
+  float rr = rmax*rmax;
+
+  std::vector<uint64_t> hist(bins,0);
+  std::mutex merge;
+
+  parallelFor(0,nFrames,[&](uint64_t first, uint64_t last, unsigned){
+    std::vector<uint64_t> local(bins,0);
+    CellList cells = CellList::withCellWidth(rmax,N);
+    for (uint64_t k = first; k < last; k++){
+      const float * x = trajectory.frame(k*frameStride);
+      cells.build(x,N,3);
+      for (uint64_t i = 0; i < N; i++){
+        cells.forNeighbours(x[i*3],x[i*3+1],[&](uint64_t j){
+          if (j <= i){return;}                                                    // each pair once
+          float rx = x[j*3]-x[i*3];
+          float ry = x[j*3+1]-x[i*3+1];
+          float dd = rx*rx+ry*ry;
+          if (dd < rr){
+            local[std::min(bins-1,uint64_t(std::sqrt(dd)/dr))] += 2;
+          }
+        });
+      }
+    }
+    std::lock_guard<std::mutex> lock(merge);
+    for (uint64_t b = 0; b < bins; b++){hist[b] += local[b];}
+  },threads);
+
+  // unit box, so the number density is just N
+  Table g({"r","g"});
+  for (uint64_t b = 0; b < bins; b++){
+    double r0 = b*dr;
+    double r1 = r0+dr;
+    double shell = M_PI*(r1*r1-r0*r0);
+    double ideal = double(nFrames)*double(N)*double(N)*shell;
+    g.addRow({r0+0.5*dr,ideal > 0.0 ? hist[b]/ideal : 0.0});
+  }
+  return g;
+}
+
+Table orientationalOrder(
+  TrajectoryReader & trajectory,
+  unsigned threads
+){
+  uint64_t F = trajectory.nFrames();
+  uint64_t N = trajectory.nParticles();
+  std::vector<double> polar(F,0.0), nematic(F,0.0);
+
+  parallelFor(0,F,[&](uint64_t first, uint64_t last, unsigned){
+    for (uint64_t t = first; t < last; t++){
+      const float * x = trajectory.frame(t);
+      double c = 0.0, s = 0.0, c2 = 0.0, s2 = 0.0;
+      for (uint64_t i = 0; i < N; i++){
+        double theta = x[i*3+2];
+        c += std::cos(theta);
+        s += std::sin(theta);
+        c2 += std::cos(2.0*theta);
+        s2 += std::sin(2.0*theta);
+      }
+      polar[t] = std::sqrt(c*c+s*s)/N;
+      nematic[t] = std::sqrt(c2*c2+s2*s2)/N;
+    }
+  },threads);
+
+  Table order({"frame","time","polar","nematic"});
+  double tau = frameTime(trajectory);
+  for (uint64_t t = 0; t < F; t++){
+    order.addRow({double(t),t*tau,polar[t],nematic[t]});
+  }
+  return order;
+}
+
+uint64_t findRoot(std::vector<uint64_t> & parent, uint64_t i){
+  while (parent[i] != i){
+    parent[i] = parent[parent[i]];                                                // path halving
+    i = parent[i];
+  }
+  return i;
+}
+
+Table clusterSizes(
+  TrajectoryReader & trajectory,
+  float cutoff,
+  uint64_t frameStride,
+  unsigned threads
+){
+  uint64_t F = trajectory.nFrames();
+  uint64_t N = trajectory.nParticles();
+  frameStride = std::max(uint64_t(1),frameStride);
+  uint64_t nFrames = (F+frameStride-1)/frameStride;
+  float cc = cutoff*cutoff;
+
+  std::map<uint64_t,uint64_t> counts;
+  std::mutex merge;
+
+  parallelFor(0,nFrames,[&](uint64_t first, uint64_t last, unsigned){
+    std::map<uint64_t,uint64_t> local;
+    CellList cells = CellList::withCellWidth(cutoff,N);
+    std::vector<uint64_t> parent(N), size(N);
+    for (uint64_t k = first; k < last; k++){
+      const float * x = trajectory.frame(k*frameStride);
+      cells.build(x,N,3);
+      for (uint64_t i = 0; i < N; i++){parent[i] = i; size[i] = 0;}
+      for (uint64_t i = 0; i < N; i++){
+        cells.forNeighbours(x[i*3],x[i*3+1],[&](uint64_t j){
+          if (j <= i){return;}
+          float rx = x[j*3]-x[i*3];
+          float ry = x[j*3+1]-x[i*3+1];
+          if (rx*rx+ry*ry < cc){
+            uint64_t a = findRoot(parent,i);
+            uint64_t b = findRoot(parent,j);
+            if (a != b){parent[std::max(a,b)] = std::min(a,b);}
+          }
+        });
+      }
+      for (uint64_t i = 0; i < N; i++){size[findRoot(parent,i)]++;}
+      for (uint64_t i = 0; i < N; i++){
+        if (size[i] > 0){local[size[i]]++;}
+      }
+    }
+    std::lock_guard<std::mutex> lock(merge);
+    for (auto it = local.begin(); it != local.end(); it++){counts[it->first] += it->second;}
+  },threads);
+
+  Table clusters({"size","clustersPerFrame","particleFraction"});
+  for (auto it = counts.begin(); it != counts.end(); it++){
+    double perFrame = double(it->second)/nFrames;
+    clusters.addRow({double(it->first),perFrame,perFrame*it->first/double(N)});
+  }
+  return clusters;
+}
@@ -0,0 +1,77 @@
+#ifndef OBSERVABLES_H
+#define OBSERVABLES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <initializer_list>
+
+#include <Trajectory/trajectory.cpp>
+#include <CellList/cellList.cpp>
+#include <parallel.h>
+
+/*
+  A named table of doubles, row major, written as CSV or as
+  a compact binary blob:
+
+  [uint64 rows][uint64 columns][columns x 32 byte names][rows x columns float64]
+*/
+struct Table {
+  Table(std::initializer_list<std::string> c)
+  : columns(c) {}
+
+  void addRow(std::initializer_list<double> row){
+    data.insert(data.end(),row.begin(),row.end());
+  }
+
+  uint64_t rows(){return data.size()/columns.size();}
+
+  std::vector<std::string> columns;
+  std::vector<double> data;
+};
+
+bool writeTable(Table & t, std::string path, bool binary);
+
+// seconds of simulated time between recorded frames
+double frameTime(TrajectoryReader & trajectory);
+
+// <|r(t+lag)-r(t)|^2> over particles and originStride spaced time origins
+Table meanSquaredDisplacement(
+  TrajectoryReader & trajectory,
+  uint64_t maxLag,
+  uint64_t originStride,
+  unsigned threads
+);
+
+// <v(t+lag).v(t)> with v from forward differences of positions
+Table velocityAutocorrelation(
+  TrajectoryReader & trajectory,
+  uint64_t maxLag,
+  uint64_t originStride,
+  unsigned threads
+);
+
+// radial distribution function up to rmax, no correction for the walls
+Table radialDistribution(
+  TrajectoryReader & trajectory,
+  float rmax,
+  uint64_t bins,
+  uint64_t frameStride,
+  unsigned threads
+);
+
+// polar |<e^{i theta}>| and nematic |<e^{2 i theta}>| order per frame
+Table orientationalOrder(
+  TrajectoryReader & trajectory,
+  unsigned threads
+);
+
+// distribution of clusters of particles closer than cutoff
+Table clusterSizes(
+  TrajectoryReader & trajectory,
+  float cutoff,
+  uint64_t frameStride,
+  unsigned threads
+);
+
+#endif
@@ -0,0 +1,191 @@
+#include <Capture/capture.h>
+
+#include <cstring>
+#include <csignal>
+#include <algorithm>
+
+FrameCapture::FrameCapture(
+  std::string pattern,
+  uint32_t width,
+  uint32_t height,
+  unsigned workers,
+  uint8_t inFlight,
+  uint8_t queued
+)
+: pattern(pattern), width(width), height(height), bytes(uint64_t(width)*height*3),
+  raw(pattern == "-"), open(true), first(0), pending(0), stopping(false),
+  frames(0), numbered(0), done(0), drops(0), failed(false)
+{
+  if (raw){
+    // a closed pipe should end the capture, not the program
+    signal(SIGPIPE,SIG_IGN);
+    workers = 1;
+  }
+  else if (workers == 0){
+    workers = std::max(1u,std::thread::hardware_concurrency()-1);
+  }
+
+  inFlight = std::max(inFlight,uint8_t(2));
+  pbos.resize(inFlight);
+  fences.assign(inFlight,0);
+  glGenBuffers(inFlight,pbos.data());
+  for (uint8_t i = 0; i < inFlight; i++){
+    glBindBuffer(GL_PIXEL_PACK_BUFFER,pbos[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER,bytes,NULL,GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+  if (glError("FrameCapture buffers") != GL_NO_ERROR){
+    open = false;
+  }
+
+  uint32_t nBuffers = std::max(uint32_t(queued),uint32_t(workers));
+  buffers.resize(nBuffers);
+  for (uint32_t b = 0; b < nBuffers; b++){
+    buffers[b].resize(bytes);
+    spare.push_back(b);
+  }
+
+  for (unsigned w = 0; w < workers; w++){
+    pool.push_back(std::thread(&FrameCapture::work,this));
+  }
+}
+
+void FrameCapture::capture(){
+  if (!open || failed){return;}
+  TraceScope trace("capture/readback");
+
+  collect(false);
+  if (pending == pbos.size()){
+    collect(true);                                                               // only if the GPU is a ring behind
+  }
+
+  uint32_t slot = (first+pending) % pbos.size();
+  glPixelStorei(GL_PACK_ALIGNMENT,1);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,pbos[slot]);
+  glReadPixels(0,0,width,height,GL_RGB,GL_UNSIGNED_BYTE,(void*)0);              // queued, returns at once
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+  fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+  frames++;
+  pending++;
+
+  glError("FrameCapture capture");
+}
+
+void FrameCapture::collect(bool wait){
+  while (pending > 0){
+    uint32_t slot = first;
+    GLenum status = glClientWaitSync(
+      fences[slot],
+      wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+      wait ? 1000000000 : 0
+    );
+    if (status == GL_TIMEOUT_EXPIRED){
+      if (!wait){return;}
+      continue;
+    }
+    wait = false;                                                                 // only ever block for the oldest
+    glDeleteSync(fences[slot]);
+    fences[slot] = 0;
+
+    uint32_t buffer = 0;
+    bool have = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!spare.empty()){
+        buffer = spare.back();
+        spare.pop_back();
+        have = true;
+      }
+    }
+
+    if (have){
+      glBindBuffer(GL_PIXEL_PACK_BUFFER,pbos[slot]);
+      void * p = glMapBufferRange(GL_PIXEL_PACK_BUFFER,0,bytes,GL_MAP_READ_BIT);
+      if (p != nullptr){
+        std::memcpy(buffers[buffer].data(),p,bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          jobs.push_back(Job{numbered++,buffer});
+        }
+        wake.notify_one();
+      }
+      else{
+        std::lock_guard<std::mutex> lock(mutex);
+        spare.push_back(buffer);
+        drops++;
+      }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+    }
+    else{
+      drops++;                                                                    // workers are behind
+    }
+
+    first = (first+1) % pbos.size();
+    pending--;
+  }
+}
+
+void FrameCapture::work(){
+  tracer().nameThread("capture");
+  char path[4096];
+  uint64_t stride = uint64_t(width)*3;
+  while (true){
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock,[this]{return !jobs.empty() || stopping;});
+      if (jobs.empty()){return;}
+      job = jobs.front();
+      jobs.pop_front();
+    }
+
+    TraceScope trace("io/capture");
+    double tic = wallClock();
+    const uint8_t * rgb = buffers[job.buffer].data();
+    if (raw){
+      if (!failed){
+        // GL rows are bottom up
+        for (uint32_t r = 0; r < height && !failed; r++){
+          if (fwrite(rgb+(height-1-r)*stride,1,stride,stdout) != stride){
+            std::cout << "Capture stream closed after " << done << " frames\n";
+            failed = true;
+          }
+        }
+        fflush(stdout);
+      }
+    }
+    else{
+      snprintf(path,sizeof(path),pattern.c_str(),int(job.frame));
+      if (!writePNG(path,rgb,width,height,true)){
+        failed = true;
+      }
+    }
+    done++;
+    telemetry().record(Metric::IO,wallClock()-tic);
+    trace.end();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    spare.push_back(job.buffer);
+  }
+}
+
+void FrameCapture::finish(){
+  if (pool.empty()){return;}
+  while (pending > 0){collect(true);}
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (unsigned w = 0; w < pool.size(); w++){
+    pool[w].join();
+  }
+  pool.clear();
+
+  glDeleteBuffers(pbos.size(),pbos.data());
+  pbos.clear();
+  open = false;
+  std::cout << "Captured " << done << " frames, " << drops << " dropped\n";
+}
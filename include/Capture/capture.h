@@ -0,0 +1,101 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <Capture/pngUtils.h>
+#include <telemetry.h>
+#include <trace.h>
+
+/*
+  Captures rendered frames without stalling the GL pipeline.
+
+  Each frame is read back into the next of a ring of pixel pack
+  buffers, glReadPixels only queues the copy. Buffers are mapped a
+  few frames later once their fence has signalled, copied into a
+  pooled CPU buffer and handed to worker threads that flip and write
+  them out, either
+
+    a PNG sequence, pattern is printf style with one int, e.g frames/%06d.png
+    raw rgb24 on stdout, pattern is "-", for piping into an encoder
+
+  PNGs are numbered by the frames kept, drops leave no gap in them.
+
+  Raw output is written in order by a single worker. Only when the
+  GPU is a whole ring behind does capture() wait on it. If the
+  workers fall behind and every CPU buffer is queued, frames are
+  dropped and counted rather than holding the render loop up.
+*/
+class FrameCapture {
+public:
+
+  FrameCapture(
+    std::string pattern,
+    uint32_t width,
+    uint32_t height,
+    unsigned workers = 0,
+    uint8_t inFlight = 3,
+    uint8_t queued = 8
+  );
+
+  ~FrameCapture(){finish();}
+
+  bool isOpen(){return open;}
+  bool isRaw(){return raw;}
+
+  // read back what has been drawn, call just before display()
+  void capture();
+  // write out everything still in flight and stop the workers
+  void finish();
+
+  uint64_t captured(){return frames;}
+  uint64_t written(){return done;}
+  uint64_t dropped(){return drops;}
+
+private:
+
+  struct Job {
+    uint64_t frame;
+    uint32_t buffer;
+  };
+
+  void collect(bool wait);
+  void work();
+
+  std::string pattern;
+  uint32_t width;
+  uint32_t height;
+  uint64_t bytes;
+  bool raw;
+  bool open;
+
+  // GPU side ring
+  std::vector<GLuint> pbos;
+  std::vector<GLsync> fences;
+  uint32_t first;
+  uint32_t pending;
+
+  // CPU side pool and work queue
+  std::vector<std::vector<uint8_t>> buffers;
+  std::vector<uint32_t> spare;                                                   // buffers not queued
+  std::deque<Job> jobs;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping;
+  std::vector<std::thread> pool;
+
+  uint64_t frames;
+  uint64_t numbered;                                                             // jobs queued, names the files
+  std::atomic<uint64_t> done;
+  std::atomic<uint64_t> drops;
+  std::atomic<bool> failed;
+};
+
+#endif
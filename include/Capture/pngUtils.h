@@ -0,0 +1,88 @@
+#ifndef PNGUTILS_H
+#define PNGUTILS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <iostream>
+
+#include <png.h>
+
+/*
+  A numbered file pattern is the snprintf format given the frame as an
+  int, so it must have exactly one integer conversion (flags and width
+  allowed, e.g frames/%06d.png) and nothing else but %% escapes.
+*/
+bool framePattern(const std::string & pattern){
+  uint8_t conversions = 0;
+  for (uint64_t i = 0; i < pattern.size(); i++){
+    if (pattern[i] != '%'){continue;}
+    i++;
+    if (i < pattern.size() && pattern[i] == '%'){continue;}
+    while (i < pattern.size() && (pattern[i] == '-' || pattern[i] == '+' || pattern[i] == ' ' || pattern[i] == '0')){i++;}
+    while (i < pattern.size() && std::isdigit((unsigned char)pattern[i])){i++;}
+    if (i >= pattern.size() || std::strchr("diu",pattern[i]) == nullptr){return false;}
+    conversions++;
+  }
+  return conversions == 1;
+}
+
+/*
+  Write 8 bit RGB pixels as a PNG. flip takes rows bottom up, as
+  glReadPixels returns them. Compression is tuned for speed, these
+  are frames headed for an encoder not an archive.
+*/
+bool writePNG(std::string path, const uint8_t * rgb, uint32_t width, uint32_t height, bool flip = true){
+  FILE * file = fopen(path.c_str(),"wb");
+  if (file == nullptr){
+    std::cout << "Could not open " << path << " for writing\n";
+    return false;
+  }
+
+  png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING,NULL,NULL,NULL);
+  png_infop info = png ? png_create_info_struct(png) : NULL;
+  if (png == NULL || info == NULL){
+    png_destroy_write_struct(&png,&info);
+    fclose(file);
+    return false;
+  }
+
+  // libpng reports errors by longjmp
+  if (setjmp(png_jmpbuf(png))){
+    std::cout << "Failed writing PNG " << path << "\n";
+    png_destroy_write_struct(&png,&info);
+    fclose(file);
+    return false;
+  }
+
+  png_init_io(png,file);
+  png_set_compression_level(png,1);
+  png_set_filter(png,PNG_FILTER_TYPE_BASE,PNG_FILTER_SUB);
+  png_set_IHDR(
+    png,
+    info,
+    width,
+    height,
+    8,
+    PNG_COLOR_TYPE_RGB,
+    PNG_INTERLACE_NONE,
+    PNG_COMPRESSION_TYPE_DEFAULT,
+    PNG_FILTER_TYPE_DEFAULT
+  );
+  png_write_info(png,info);
+
+  uint64_t stride = uint64_t(width)*3;
+  for (uint32_t r = 0; r < height; r++){
+    uint32_t row = flip ? height-1-r : r;
+    png_write_row(png,(png_const_bytep)(rgb+row*stride));
+  }
+
+  png_write_end(png,NULL);
+  png_destroy_write_struct(&png,&info);
+  fclose(file);
+  return true;
+}
+
+#endif
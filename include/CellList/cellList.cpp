@@ -0,0 +1,38 @@
+#include <CellList/cellList.h>
+
+void CellList::clear(){
+  for (uint64_t c = 0; c < cells.size(); c++){
+    cells[c] = NULL_INDEX;
+    occupancy[c] = 0;
+  }
+  for (uint64_t i = 0; i < list.size(); i++){
+    list[i] = NULL_INDEX;
+  }
+}
+
+void CellList::resize(uint64_t nParticles){
+  list.resize(nParticles,NULL_INDEX);
+}
+
+void CellList::insert(uint64_t cell, uint64_t particle){
+  occupancy[cell]++;
+  if (cells[cell] == NULL_INDEX){
+    cells[cell] = particle;                                                       // we are the head!
+    return;
+  }
+  uint64_t i = cells[cell];
+  while (list[i] != NULL_INDEX){
+    i = list[i];                                                                  // someone here!
+  }
+  list[i] = particle;                                                             // it's free realestate
+}
+
+void CellList::build(const float * x, uint64_t n, uint64_t stride){
+  if (list.size() < n){
+    resize(n);
+  }
+  clear();
+  for (uint64_t i = 0; i < n; i++){
+    insert(hash(x[i*stride],x[i*stride+1]),i);                                    // flat index for the particle's cell
+  }
+}
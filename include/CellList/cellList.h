@@ -0,0 +1,89 @@
+#ifndef CELLLIST_H
+#define CELLLIST_H
+
+#include <cstdint>
+#include <vector>
+#include <cmath>
+
+const uint64_t NULL_INDEX = uint64_t(-1);
+
+/*
+  Cell linked list over the unit box [0,1]x[0,1].
+
+  The box is cut into Nc x Nc cells, cells[a*Nc+b] holds the
+  first particle in cell (a,b) and list[i] the particle after
+  i in the same cell (or NULL_INDEX). occupancy[a*Nc+b] counts
+  the particles in (a,b).
+*/
+class CellList {
+public:
+
+  CellList()
+  : Nc(1), delta(1.0) {}
+
+  CellList(uint64_t Nc, uint64_t nParticles = 0)
+  : Nc(Nc), delta(1.0/Nc), cells(Nc*Nc,NULL_INDEX), list(nParticles,NULL_INDEX), occupancy(Nc*Nc,0) {}
+
+  // the finest grid whose cells are at least width wide
+  static CellList withCellWidth(float width, uint64_t nParticles = 0){
+    uint64_t n = uint64_t(std::floor(1.0/width));
+    return CellList(n < 1 ? 1 : n,nParticles);
+  }
+
+  uint64_t size(){return Nc;}
+  float cellWidth(){return delta;}
+
+  uint64_t cellIndex(float x){
+    int64_t a = int64_t(std::floor(x/delta));
+    return a < 0 ? 0 : (a >= int64_t(Nc) ? Nc-1 : a);
+  }
+
+  uint64_t hash(float x, float y){
+    return cellIndex(x)*Nc + cellIndex(y);
+  }
+
+  // the Nc^2 cell heads and per particle links, e.g for memory accounting
+  const std::vector<uint64_t> & cellHeads(){return cells;}
+  const std::vector<uint64_t> & links(){return list;}
+  const std::vector<uint32_t> & counts(){return occupancy;}
+
+  uint64_t head(uint64_t a, uint64_t b){return cells[a*Nc+b];}
+  uint32_t count(uint64_t a, uint64_t b){return occupancy[a*Nc+b];}
+  uint64_t next(uint64_t particle){return list[particle];}
+
+  void clear();
+  void resize(uint64_t nParticles);
+  void insert(uint64_t cell, uint64_t particle);
+
+  // bin n particles whose positions start every stride floats in x
+  void build(const float * x, uint64_t n, uint64_t stride);
+
+  // call f(j) for every particle j in the 3x3 block of cells around (x,y)
+  template <class F>
+  void forNeighbours(float x, float y, F f){
+    int64_t a = cellIndex(x);
+    int64_t b = cellIndex(y);
+    for (int64_t i = a-1; i <= a+1; i++){
+      if (i < 0 || i >= int64_t(Nc)){continue;}
+      for (int64_t j = b-1; j <= b+1; j++){
+        if (j < 0 || j >= int64_t(Nc)){continue;}
+        uint64_t p = cells[i*Nc+j];
+        while (p != NULL_INDEX){
+          f(p);
+          p = list[p];
+        }
+      }
+    }
+  }
+
+private:
+
+  uint64_t Nc;
+  float delta;
+
+  std::vector<uint64_t> cells;
+  std::vector<uint64_t> list;
+  std::vector<uint32_t> occupancy;
+};
+
+#endif
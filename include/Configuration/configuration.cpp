@@ -0,0 +1,237 @@
+#include <Configuration/configuration.h>
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool isNumberStart(char c){
+  return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+// bounded float parser, mapped files are not null terminated
+bool parseFloat(const char * & p, const char * end, float & value){
+  double sign = 1.0;
+  if (p < end && (*p == '-' || *p == '+')){
+    sign = *p == '-' ? -1.0 : 1.0;
+    p++;
+  }
+  double v = 0.0;
+  bool digits = false;
+  while (p < end && *p >= '0' && *p <= '9'){
+    v = v*10.0+(*p-'0');
+    p++;
+    digits = true;
+  }
+  if (p < end && *p == '.'){
+    p++;
+    double scale = 0.1;
+    while (p < end && *p >= '0' && *p <= '9'){
+      v += (*p-'0')*scale;
+      scale *= 0.1;
+      p++;
+      digits = true;
+    }
+  }
+  if (!digits){return false;}
+  if (p < end && (*p == 'e' || *p == 'E')){
+    p++;
+    int esign = 1;
+    if (p < end && (*p == '-' || *p == '+')){
+      esign = *p == '-' ? -1 : 1;
+      p++;
+    }
+    int e = 0;
+    while (p < end && *p >= '0' && *p <= '9'){
+      e = e*10+(*p-'0');
+      p++;
+    }
+    v *= std::pow(10.0,esign*e);
+  }
+  value = float(sign*v);
+  return true;
+}
+
+// parse the lines in [begin,end) appending x,y,theta to out, counting
+// lines and noting the first (from 1) with a non finite value
+uint64_t parseCSVChunk(
+  const char * begin,
+  const char * end,
+  std::vector<float> & out,
+  uint64_t & lines,
+  uint64_t & nonFinite
+){
+  uint64_t bad = 0;
+  lines = 0;
+  nonFinite = 0;
+  const char * p = begin;
+  while (p < end){
+    const char * eol = (const char*)memchr(p,'\n',end-p);
+    if (eol == nullptr){eol = end;}
+    lines++;
+
+    while (p < eol && (*p == ' ' || *p == '\t')){p++;}
+    if (p < eol && isNumberStart(*p)){
+      float v[3] = {0.0,0.0,0.0};
+      int n = 0;
+      while (n < 3 && p < eol && parseFloat(p,eol,v[n])){
+        n++;
+        while (p < eol && (*p == ',' || *p == ' ' || *p == '\t' || *p == ';' || *p == '\r')){p++;}
+      }
+      if (n >= 2 && nonFinite == 0 && !(std::isfinite(v[0]) && std::isfinite(v[1]) && std::isfinite(v[2]))){
+        nonFinite = lines;
+      }
+      if (n >= 2){
+        out.push_back(v[0]);
+        out.push_back(v[1]);
+        out.push_back(v[2]);
+      }
+      else{
+        bad++;
+      }
+    }
+    p = eol+1;
+  }
+  return bad;
+}
+
+bool loadCSV(const char * data, uint64_t length, std::vector<float> & state, unsigned threads){
+  if (threads == 0){threads = defaultThreads();}
+  // ~1MB minimum per chunk, splitting tiny files costs more than it saves
+  threads = unsigned(std::max(uint64_t(1),std::min(uint64_t(threads),length>>20)));
+
+  // chunk boundaries moved forward to the next line start
+  std::vector<const char*> bounds(threads+1);
+  bounds[0] = data;
+  bounds[threads] = data+length;
+  for (unsigned t = 1; t < threads; t++){
+    const char * b = data+(length*t)/threads;
+    const char * eol = (const char*)memchr(b,'\n',data+length-b);
+    bounds[t] = eol == nullptr ? data+length : std::max(bounds[t-1],eol+1);
+  }
+
+  std::vector<std::vector<float>> parsed(threads);
+  std::vector<uint64_t> bad(threads,0);
+  std::vector<uint64_t> lines(threads,0);
+  std::vector<uint64_t> nonFinite(threads,0);
+  parallelFor(0,threads,[&](uint64_t first, uint64_t last, unsigned){
+    for (uint64_t t = first; t < last; t++){
+      // rough guess at ~30 bytes a line to avoid regrowing
+      parsed[t].reserve(3*(bounds[t+1]-bounds[t])/30);
+      bad[t] = parseCSVChunk(bounds[t],bounds[t+1],parsed[t],lines[t],nonFinite[t]);
+    }
+  },threads);
+
+  std::vector<uint64_t> offsets(threads+1,0);
+  uint64_t badLines = 0;
+  for (unsigned t = 0; t < threads; t++){
+    offsets[t+1] = offsets[t]+parsed[t].size();
+    badLines += bad[t];
+  }
+  if (badLines > 0){
+    std::cout << "Skipped " << badLines << " malformed lines\n";
+  }
+  uint64_t line = 0;
+  for (unsigned t = 0; t < threads; t++){
+    if (nonFinite[t] > 0){
+      std::cout << "Non finite x, y or theta on line " << line+nonFinite[t] << "\n";
+      return false;
+    }
+    line += lines[t];
+  }
+
+  state.resize(offsets[threads]);
+  parallelFor(0,threads,[&](uint64_t first, uint64_t last, unsigned){
+    for (uint64_t t = first; t < last; t++){
+      if (parsed[t].size() > 0){
+        std::memcpy(&state[offsets[t]],parsed[t].data(),sizeof(float)*parsed[t].size());
+      }
+      std::vector<float>().swap(parsed[t]);
+    }
+  },threads);
+  return true;
+}
+
+// the first x,y,theta triple (from 1) with a non finite value, 0 if none
+uint64_t firstNonFinite(const std::vector<float> & state){
+  for (uint64_t i = 0; i < state.size(); i++){
+    if (!std::isfinite(state[i])){return i/3+1;}
+  }
+  return 0;
+}
+
+bool hasExtension(std::string path, std::string ext){
+  return path.size() >= ext.size() && path.compare(path.size()-ext.size(),ext.size(),ext) == 0;
+}
+
+bool loadConfiguration(std::string path, std::vector<float> & state, unsigned threads){
+  int fd = open(path.c_str(),O_RDONLY);
+  if (fd < 0){
+    std::cout << "Could not open configuration: " << path << "\n";
+    return false;
+  }
+  struct stat s;
+  if (fstat(fd,&s) != 0 || s.st_size == 0){
+    std::cout << "Empty configuration: " << path << "\n";
+    close(fd);
+    return false;
+  }
+  uint64_t length = s.st_size;
+  void * m = mmap(nullptr,length,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if (m == MAP_FAILED){
+    std::cout << "Could not map configuration: " << path << "\n";
+    return false;
+  }
+  madvise(m,length,MADV_SEQUENTIAL);
+  const char * data = (const char*)m;
+  bool ok = true;
+  bool csv = false;
+
+  if (length >= sizeof(TrajectoryHeader) && std::memcmp(data,TRAJECTORY_MAGIC,sizeof(TRAJECTORY_MAGIC)) == 0){
+    TrajectoryHeader h;
+    std::memcpy(&h,data,sizeof(h));
+    uint64_t frameBytes = h.nParticles*h.stride*sizeof(float);
+    uint64_t frames = frameBytes > 0 ? (length-sizeof(h))/frameBytes : 0;
+    if (h.stride != 3 || frames == 0){
+      std::cout << "Trajectory has no usable frames: " << path << "\n";
+      ok = false;
+    }
+    else{
+      state.resize(h.nParticles*3);
+      std::memcpy(&state[0],data+sizeof(h)+(frames-1)*frameBytes,frameBytes);
+    }
+  }
+  else if (hasExtension(path,".bin") || hasExtension(path,".raw")){
+    if (length % (3*sizeof(float)) != 0){
+      std::cout << "Binary configuration is not whole x,y,theta float32 triples: " << path << "\n";
+      ok = false;
+    }
+    else{
+      state.resize(length/sizeof(float));
+      std::memcpy(&state[0],data,length);
+    }
+  }
+  else{
+    csv = true;
+    ok = loadCSV(data,length,state,threads);
+  }
+
+  munmap(m,length);
+  // parsed CSV is checked per line above, positions reach the cell hash unchecked
+  uint64_t record = ok && !csv ? firstNonFinite(state) : 0;
+  if (record > 0){
+    std::cout << "Non finite x, y or theta in record " << record << ": " << path << "\n";
+    ok = false;
+  }
+  if (ok && state.size() == 0){
+    std::cout << "No particles in configuration: " << path << "\n";
+    ok = false;
+  }
+  return ok;
+}
@@ -0,0 +1,31 @@
+#ifndef CONFIGURATION_H
+#define CONFIGURATION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Trajectory/trajectory.h>
+#include <parallel.h>
+
+/*
+  Initial configurations as x,y,theta triples in the unit box.
+
+  Accepted files
+    - trajectories (see Trajectory/trajectory.h), the last frame is used
+    - .bin/.raw, headerless little endian float32 x,y,theta triples
+    - anything else is CSV, one particle per line "x,y[,theta]",
+      commas or whitespace as separators, lines that do not start
+      with a number (headers, # comments) are skipped and a
+      missing theta is 0
+
+  A NaN or infinite x, y or theta fails the load, naming its line
+  (CSV) or record.
+*/
+bool loadConfiguration(
+  std::string path,
+  std::vector<float> & state,
+  unsigned threads = 0
+);
+
+#endif
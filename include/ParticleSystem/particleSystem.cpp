@@ -1,34 +1,9 @@
 #include <ParticleSystem/particleSystem.h>
 #include <time.h>
 
-void ParticleSystem::resetLists(){
-  for (int i = 0; i < Nc*Nc; i++){
-    cells[i] = NULL_INDEX;
-  }
-  for (int i = 0; i < nParticles; i++){
-    list[i] = NULL_INDEX;
-  }
-}
-
-void ParticleSystem::insert(uint64_t next, uint64_t particle){
-  uint64_t i = next;
-  while (list[i] != NULL_INDEX){
-    i = list[i];                                                                  // someone here!
-  }
-  list[i] = particle;                                                             // it's free realestate
-}
-
 void ParticleSystem::populateLists(
 ){
-  for (int i = 0; i < nParticles; i++){
-    uint64_t c = hash(i);                                                    // flat index for the particle's cell
-    if (cells[c] == NULL_INDEX){
-      cells[c] = uint64_t(i);                                                     // we are the head!
-    }
-    else{
-      insert(cells[c],uint64_t(i));
-    }
-  }
+  cellList.build(&state[0],nParticles,3);
 }
 
 void ParticleSystem::handleCollision(uint64_t i, uint64_t j){
@@ -60,29 +35,31 @@ void ParticleSystem::cellCollisions(
   if (a1 < 0 || a1 >= Nc || b1 < 0 || b1 >= Nc || a2 < 0 || a2 >= Nc || b2 < 0 || b2 >= Nc){
     return;                                                                      // not a cell
   }
-  uint64_t p1 = cells[a1*Nc+b1];
-  uint64_t p2 = cells[a2*Nc+b2];
+  uint64_t p1 = cellList.head(a1,b1);
+  uint64_t p2 = cellList.head(a2,b2);
 
   if (p1 == NULL_INDEX || p2 == NULL_INDEX){
     return;                                                                      // nobody here!
   }
 
   while (p1 != NULL_INDEX){
-    p2 = cells[a2*Nc+b2];                                                        // flat index
+    p2 = cellList.head(a2,b2);                                                   // flat index
     while(p2 != NULL_INDEX){
         handleCollision(p1,p2);                                                  // check this potential collision
-        p2 = list[p2];                                                           // p2 points to a new particle in the same box (or null)
+        p2 = cellList.next(p2);                                                  // p2 points to a new particle in the same box (or null)
     }
-    p1 = list[p1];                                                               // p1 points to a new particle in the same box (or null)
+    p1 = cellList.next(p1);                                                      // p1 points to a new particle in the same box (or null)
   }
 }
 
 void ParticleSystem::addRepeller(float x, float y){
   repellers.push_back(std::pair<float,float>(x,y));
+  toyEdits++;
 }
 
 void ParticleSystem::addAttractor(float x, float y){
   attractors.push_back(std::pair<float,float>(x,y));
+  toyEdits++;
 }
 
 bool ParticleSystem::deleteAttratorRepellor(float x, float y){
@@ -92,6 +69,7 @@ bool ParticleSystem::deleteAttratorRepellor(float x, float y){
     float ry = y-attractors[i].second;
     if (rx*rx+ry*ry < dist){
       attractors.erase(attractors.begin()+i);
+      toyEdits++;
       return true;
     }
   }
@@ -101,22 +79,49 @@ bool ParticleSystem::deleteAttratorRepellor(float x, float y){
     float ry = y-repellers[i].second;
     if (rx*rx+ry*ry < dist){
       repellers.erase(repellers.begin()+i);
+      toyEdits++;
       return true;
     }
   }
   return false;
 }
 
+void ParticleSystem::beginPhases(){
+  if (countersWanted && !countersOpen){
+    countersOpen = true;                                                          // tried once, on this thread
+    counters.open();
+    for (uint8_t c = 0; c < PERF_COUNTERS; c++){
+      stats.haveCounter[c] = counters.have(PerfCounter(c));
+    }
+  }
+  if (countersOpen){phaseCounters = counters.read();}
+  phaseTic = wallClock();
+}
+
+void ParticleSystem::endPhase(StepPhase p){
+  double toc = wallClock();
+  PhaseStats & phase = stats.phases[p];
+  phase.calls++;
+  phase.seconds += toc-phaseTic;
+  if (countersOpen){
+    PerfSample now = counters.read();
+    phase.counters += now-phaseCounters;
+    phaseCounters = now;
+  }
+  phaseTic = toc;
+}
+
 void ParticleSystem::step(){
-  clock_t tic = clock();
+  TraceScope trace("step/cells");
+  beginPhases();
   for (int i = 0; i < nParticles; i++){
     forces[i*2] = 0.0;
     forces[i*2+1] = 0.0;
   }
-  resetLists();
   populateLists();
-  float setup = (clock()-tic)/float(CLOCKS_PER_SEC);
-  tic = clock();
+  measureLoad();
+  endPhase(PHASE_CELLS);
+  trace.next("step/collisions");
   for (int a = 0; a < Nc; a++){
     for (int b = 0; b < Nc; b++){
       // draw it out, we can get away without
@@ -133,8 +138,8 @@ void ParticleSystem::step(){
       cellCollisions(a,b,a,b+1);
     }
   }
-  float col = (clock()-tic)/float(CLOCKS_PER_SEC);
-  tic = clock();
+  endPhase(PHASE_COLLISIONS);
+  trace.next("step/integrate");
 
   float D = std::sqrt(2.0*rotationalDiffusion/dt);
   float dtdt = dt*dt;
@@ -156,8 +161,8 @@ void ParticleSystem::step(){
         float d = sqrt(rx*rx+ry*ry);
 
         if (d < radius){
-          std::uniform_real_distribution<float> U(0.0,6.28);
-          float theta = U(generator);
+          std::uniform_real_distribution<float> angle(0.0,6.28);
+          float theta = angle(generator);
           forces[i*2] -= attractionStrength*cos(theta)/d;
           forces[i*2+1] -= attractionStrength*sin(theta)/d;
         }
@@ -236,34 +241,211 @@ void ParticleSystem::step(){
     if (state[i*3] == 1.0){ state[i*3] -= 0.001;}
     if (state[i*3+1] == 1.0){ state[i*3+1] -= 0.001;}
   }
-  float updates = (clock()-tic)/float(CLOCKS_PER_SEC);
-  tic = clock();
+  endPhase(PHASE_INTEGRATE);
+  steps++;
+
+  if (shared && steps % shareEvery == 0){
+    shared->write(&state[0],size(),steps,wallClock());
+  }
+
+  stats.steps = steps;
+  stats.particles = nParticles;
+  memoryChanged = hostMemory(memoryLocal) || memoryChanged;
+  // a reader mid copy just means this step's totals are skipped
+  if (statsMutex.try_lock()){
+    statsSnapshot = stats;
+    if (memoryChanged){
+      memorySnapshot = memoryLocal;                                               // same entries, strings keep their buffers
+      memoryChanged = false;
+    }
+    statsMutex.unlock();
+  }
 }
 
-void ParticleSystem::setProjection(glm::mat4 p){
-  projection = p;
-  glUseProgram(particleShader);
-  glUniformMatrix4fv(
-    glGetUniformLocation(particleShader,"proj"),
-    1,
-    GL_FALSE,
-    &projection[0][0]
-  );
-  glUseProgram(arShader);
-  glUniformMatrix4fv(
-    glGetUniformLocation(arShader,"proj"),
-    1,
-    GL_FALSE,
-    &projection[0][0]
-  );
+void ParticleSystem::measureLoad(){
+  const std::vector<uint32_t> & n = cellList.counts();
+  bool keep = heatmapMode == HEATMAP_PAIRS;
+  if (keep){cellPairs.resize(Nc*Nc);}
+
+  CellLoad & l = stats.load;
+  l = CellLoad();
+  l.cells = Nc*Nc;
+  for (uint64_t a = 0; a < Nc; a++){
+    for (uint64_t b = 0; b < Nc; b++){
+      uint64_t c = a*Nc+b;
+      uint64_t k = n[c];
+      // the same neighbours step() sweeps, each pair of cells once
+      uint64_t others = k;
+      if (a+1 < Nc){
+        others += n[c+Nc];
+        if (b+1 < Nc){others += n[c+Nc+1];}
+        if (b > 0){others += n[c+Nc-1];}
+      }
+      if (b+1 < Nc){others += n[c+1];}
+      uint64_t pairs = k*others;
+
+      if (k > 0){l.occupied++;}
+      l.maxOccupancy = std::max(l.maxOccupancy,k);
+      l.occupancyHistogram[std::min(k,uint64_t(OCCUPANCY_BINS-1))]++;
+      l.pairTests += pairs;
+      l.maxCellPairTests = std::max(l.maxCellPairTests,pairs);
+      uint8_t bin = 0;
+      for (uint64_t p = pairs; p > 0 && bin < PAIR_BINS-1; p >>= 1){bin++;}
+      l.pairHistogram[bin]++;
+
+      if (keep){cellPairs[c] = uint32_t(std::min(pairs,uint64_t(UINT32_MAX)));}
+    }
+  }
+}
+
+// the arrays the stepping thread owns, only called from it. Once r has
+// its entries the figures are updated in place, so the per step check
+// allocates nothing; true if any changed
+bool ParticleSystem::hostMemory(MemoryReport & r){
+  struct Figure {
+    const char * name;
+    uint64_t used;
+    uint64_t capacity;
+  };
+  auto bytes = [](const char * name, uint64_t size, uint64_t capacity, uint64_t element){
+    return Figure{name,size*element,capacity*element};
+  };
+  // the slots are sized once by publish(), from the counts rather than
+  // reading vectors the render thread holds
+  uint64_t frameBytes = 3*(6*nParticles*sizeof(float)+(Nc*Nc+1)*sizeof(uint64_t));
+  const Figure figures[] = {
+    bytes("state",state.size(),state.capacity(),sizeof(float)),
+    bytes("lastState",lastState.size(),lastState.capacity(),sizeof(float)),
+    bytes("forces",forces.size(),forces.capacity(),sizeof(float)),
+    bytes("noise",noise.size(),noise.capacity(),sizeof(float)),
+    bytes("cell heads (Nc^2)",cellList.cellHeads().size(),cellList.cellHeads().capacity(),sizeof(uint64_t)),
+    bytes("cell links",cellList.links().size(),cellList.links().capacity(),sizeof(uint64_t)),
+    bytes("cell counts (Nc^2)",cellList.counts().size(),cellList.counts().capacity(),sizeof(uint32_t)),
+    bytes("cell pairs (Nc^2)",cellPairs.size(),cellPairs.capacity(),sizeof(uint32_t)),
+    bytes("publish sort",sortCell.size()+sortNext.size(),sortCell.capacity()+sortNext.capacity(),sizeof(uint64_t)),
+    {"frames (3 slots)",frameBytes,frameBytes},
+    {"shared frames",shared ? shared->bytes() : 0,shared ? shared->bytes() : 0}
+  };
+  uint8_t n = sizeof(figures)/sizeof(Figure)-(shared ? 0 : 1);
+
+  bool changed = r.particles != size();
+  r.particles = size();
+  if (r.entries.size() != n){
+    r.entries.resize(n);
+    for (uint8_t i = 0; i < n; i++){
+      r.entries[i].name = figures[i].name;
+      r.entries[i].gpu = false;
+    }
+    changed = true;
+  }
+  for (uint8_t i = 0; i < n; i++){
+    MemoryEntry & e = r.entries[i];
+    if (e.used != figures[i].used || e.capacity != figures[i].capacity){
+      e.used = figures[i].used;
+      e.capacity = figures[i].capacity;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+// what the render thread owns, only called from it after a draw
+void ParticleSystem::snapshotRenderMemory(){
+  std::vector<MemoryEntry> r;
+  r.push_back(vectorMemory("density texels",densityTexels));
+  r.push_back(vectorMemory("heatmap texels",heatmapTexels));
+  r.push_back({"instances",instances.size(),instances.bytes(),true});
+  uint64_t texture = densitySize*densitySize*4;
+  r.push_back({"density texture",texture,texture,true});
+  if (renderMemoryMutex.try_lock()){
+    renderMemory = std::move(r);
+    renderMemoryMutex.unlock();
+  }
+}
+
+MemoryReport ParticleSystem::memory(){
+  MemoryReport r;
+  {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    r = memorySnapshot;
+  }
+  {
+    std::lock_guard<std::mutex> lock(renderMemoryMutex);
+    r.entries.insert(r.entries.end(),renderMemory.begin(),renderMemory.end());
+  }
+  processMemory(r.rss,r.peakRss);
+  return r;
+}
+
+bool ParticleSystem::shareFrames(std::string name, uint64_t every, uint32_t slots){
+  shared.reset(new SharedFrames(name,nParticles,slots,dt,density,radius,uint32_t(every)));
+  if (!shared->isOpen()){
+    shared.reset();
+    return false;
+  }
+  shareEvery = std::max(every,uint64_t(1));
+  {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    hostMemory(memoryLocal);
+    memorySnapshot = memoryLocal;
+  }
+  std::cout << "Sharing every " << shareEvery << " steps in " << shared->getName() << " ("
+    << formatBytes(shared->bytes()) << ", " << slots << " slots)\n";
+  return true;
+}
+
+void ParticleSystem::publish(double time, double interval){
+  TraceScope trace("publish");
+  ParticleFrame & f = frames.back();
+  uint64_t cells = Nc*Nc;
+
+  // counting sort by current cell, every slot's vectors keep their capacity
+  f.Nc = Nc;
+  f.cellStart.assign(cells+1,0);
+  sortCell.resize(nParticles);
+  for (uint64_t i = 0; i < nParticles; i++){
+    uint64_t c = hash(i);
+    sortCell[i] = c;
+    f.cellStart[c+1]++;
+  }
+  for (uint64_t c = 0; c < cells; c++){
+    f.cellStart[c+1] += f.cellStart[c];
+  }
+
+  f.state.resize(nParticles*3);
+  f.previous.resize(nParticles*3);
+  sortNext.assign(f.cellStart.begin(),f.cellStart.end()-1);
+  for (uint64_t i = 0; i < nParticles; i++){
+    uint64_t j = sortNext[sortCell[i]]++;
+    for (int k = 0; k < 3; k++){
+      f.state[j*3+k] = state[i*3+k];
+      f.previous[j*3+k] = lastState[i*3+k];
+    }
+  }
+
+  f.time = time;
+  f.interval = interval;
+  f.attractors = attractors;
+  f.repellers = repellers;
+  f.toyEdits = toyEdits;
+  f.step = steps;
+
+  f.heatmap = heatmapMode;
+  if (f.heatmap == HEATMAP_OCCUPANCY){
+    f.cellLoad.assign(cellList.counts().begin(),cellList.counts().end());
+  }
+  else if (f.heatmap == HEATMAP_PAIRS && cellPairs.size() == cells){
+    f.cellLoad.assign(cellPairs.begin(),cellPairs.end());
+  }
+  else{
+    f.heatmap = HEATMAP_OFF;                                                      // no pairs measured yet
+  }
+  frames.publish();
 }
 
 void ParticleSystem::initialiseGL(){
-  // a buffer of particle states
-  glGenBuffers(1,&offsetVBO);
-  glBindBuffer(GL_ARRAY_BUFFER,offsetVBO);
-  glBufferData(GL_ARRAY_BUFFER,sizeof(float)*nParticles*3,&state[0],GL_DYNAMIC_DRAW);
-  glBindBuffer(GL_ARRAY_BUFFER,0);
+  // a streamed ring of packed particle states, rewritten every frame
+  instances.initialise(sizeof(uint16_t)*nParticles*3);
 
   // setup an array object
   glGenVertexArrays(1,&vertVAO);
@@ -276,24 +458,21 @@ void ParticleSystem::initialiseGL(){
   glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,3*sizeof(float),(void*)0);
 
   glEnableVertexAttribArray(1);
-  glBindBuffer(GL_ARRAY_BUFFER, offsetVBO);
+  glBindBuffer(GL_ARRAY_BUFFER, instances.id());
   // place states
-  glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,3*sizeof(float),(void*)0);
+  glVertexAttribPointer(1,3,GL_UNSIGNED_SHORT,GL_TRUE,3*sizeof(uint16_t),(void*)0);
   glBindBuffer(GL_ARRAY_BUFFER,0);
   glVertexAttribDivisor(1,1);
 
   glError("initialised particles");
 
-  particleShader = glCreateProgram();
-  compileShader(particleShader,particleVertexShader,particleFragmentShader);
+  particleShader = shaderManager().program(particleVertexShader,particleFragmentShader);
   glUseProgram(particleShader);
+  glUniform1f(shaderManager().location(particleShader,"radius"),radius);
+  particleOpacity = shaderManager().location(particleShader,"opacity");
+  glUniform1f(particleOpacity,1.0);
+  setParticleOpacity = 1.0;
 
-  glUniformMatrix4fv(
-    glGetUniformLocation(particleShader,"proj"),
-    1,
-    GL_FALSE,
-    &projection[0][0]
-  );
   // now for the toys
   for (int i = 0; i < 16; i++){
     arOffsets[i] = i;
@@ -316,35 +495,62 @@ void ParticleSystem::initialiseGL(){
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
 
-  arShader = glCreateProgram();
-  compileShader(arShader,atrepVertexShader,atRepfragmentShader);
+  arShader = shaderManager().program(atrepVertexShader,atRepfragmentShader);
   glUseProgram(arShader);
+  glUniform1f(shaderManager().location(arShader,"radius"),radius);
+  glUniform1f(shaderManager().location(arShader,"T"),ARPERIOD);
+  arT = shaderManager().location(arShader,"t");
+  arNA = shaderManager().location(arShader,"na");
+  arNR = shaderManager().location(arShader,"nr");
+  arAttr = shaderManager().location(arShader,"attr");
+  arRep = shaderManager().location(arShader,"rep");
 
-  glUniform1f(
-    glGetUniformLocation(arShader,"maxNANR"),
-    float(8)
-  );
-
-  glUniformMatrix4fv(
-    glGetUniformLocation(arShader,"proj"),
-    1,
-    GL_FALSE,
-    &projection[0][0]
-  );
-
-  glUniformMatrix4fv(
-    glGetUniformLocation(arShader,"toys"),
-    1,
-    GL_FALSE,
-    &arPositions[0][0]
-  );
+  glError("initialised toys");
 
-  glUniform1f(
-    glGetUniformLocation(arShader,"T"),
-    ARPERIOD
-  );
+  // density field level of detail, a unit quad scaled to the box in the shader
+  float quad[8] = {0.0,0.0, 1.0,0.0, 0.0,1.0, 1.0,1.0};
+  glGenVertexArrays(1,&densityVAO);
+  glGenBuffers(1,&densityVBO);
+  glBindVertexArray(densityVAO);
+  glBindBuffer(GL_ARRAY_BUFFER,densityVBO);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(quad),quad,GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0,2,GL_FLOAT,GL_FALSE,2*sizeof(float),(void*)0);
+  glBindBuffer(GL_ARRAY_BUFFER,0);
+  glBindVertexArray(0);
 
-  glError("initialised toys");
+  glGenTextures(1,&densityTexture);
+  glBindTexture(GL_TEXTURE_2D,densityTexture);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D,0);
+
+  densityShader = shaderManager().program(densityVertexShader,densityFragmentShader);
+  glUseProgram(densityShader);
+  glUniform1i(shaderManager().location(densityShader,"density"),0);
+  densityExtent = shaderManager().location(densityShader,"extent");
+  densityOpacity = shaderManager().location(densityShader,"opacity");
+
+  glError("initialised density");
+
+  glGenTextures(1,&heatmapTexture);
+  glBindTexture(GL_TEXTURE_2D,heatmapTexture);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);                // hard cell edges
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D,0);
+
+  heatmapShader = shaderManager().program(densityVertexShader,heatmapFragmentShader);
+  glUseProgram(heatmapShader);
+  glUniform1i(shaderManager().location(heatmapShader,"load"),0);
+  heatmapExtent = shaderManager().location(heatmapShader,"extent");
+  glUniform2f(heatmapExtent,1.0,1.0);                                            // one texel per cell, exactly the box
+
+  glError("initialised heatmap");
+  glReady = true;
 }
 
 glm::mat4 attractionRepulsionMatrix(std::vector<std::pair<float,float>> & data, int m){
@@ -360,83 +566,453 @@ glm::mat4 attractionRepulsionMatrix(std::vector<std::pair<float,float>> & data,
   return ar;
 }
 
+// 16 bit normalised position in the unit box, clamped
+uint16_t quantisePosition(float x){
+  int32_t q = int32_t(x*65535.0f+0.5f);
+  return uint16_t(q < 0 ? 0 : (q > 65535 ? 65535 : q));
+}
+
+// theta/2PI to 16 bits, the integer wrap takes care of the period
+uint16_t quantiseAngle(float theta){
+  float t = theta*float(1.0/(2.0*M_PI));
+  return uint16_t(int32_t((t-float(int32_t(t)))*65536.0f));                     // (-1,1) before the wrap
+}
+
+/*
+  Interpolate n x,y,theta triples from a towards b and quantise them
+  to 16 bit normalised x,y and theta/2PI, half the bytes of the float
+  state. 1/65535 of the box is still well under a pixel for any
+  sensible zoom.
+
+  Blocks of 4 particles are 12 uniform lanes, each lane computes both
+  quantisations and a constant mask picks one, so the inner loop has
+  no branches or stride 3 accesses and vectorises.
+*/
+void packInstances(
+  const float * __restrict a,
+  const float * __restrict b,
+  float alpha,
+  uint64_t n,
+  uint16_t * __restrict out
+){
+  static const int32_t angle[12] = {0,0,-1,0,0,-1,0,0,-1,0,0,-1};
+  const float inv2Pi = 1.0/(2.0*M_PI);
+  uint64_t blocks = (n/4)*12;
+  for (uint64_t i = 0; i < blocks; i += 12){
+    for (int j = 0; j < 12; j++){
+      float v = a[i+j]+alpha*(b[i+j]-a[i+j]);
+      int32_t p = int32_t(v*65535.0f+0.5f);
+      p = p < 0 ? 0 : (p > 65535 ? 65535 : p);
+      float t = v*inv2Pi;
+      int32_t q = int32_t((t-float(int32_t(t)))*65536.0f);
+      out[i+j] = uint16_t((q & angle[j]) | (p & ~angle[j]));
+    }
+  }
+  for (uint64_t i = blocks; i < n*3; i += 3){
+    out[i] = quantisePosition(a[i]+alpha*(b[i]-a[i]));
+    out[i+1] = quantisePosition(a[i+1]+alpha*(b[i+1]-a[i+1]));
+    out[i+2] = quantiseAngle(a[i+2]+alpha*(b[i+2]-a[i+2]));
+  }
+}
+
 void ParticleSystem::draw(
   uint64_t frameId,
   float zoomLevel,
   float resX,
   float resY
 ){
-  glUseProgram(particleShader);
+  if (!glReady){initialiseGL();}
+  TraceScope trace("draw");
+  gpuTimers().begin(GPU_PARTICLES);
+  drawScene(zoomLevel,resX,resY);
+  gpuTimers().end(GPU_PARTICLES);
+  gpuTimers().begin(GPU_TOYS);
+  drawToys(frameId,zoomLevel,resX);
+  gpuTimers().end(GPU_TOYS);
+  snapshotRenderMemory();
+}
 
-  glUniform1f(
-    glGetUniformLocation(particleShader,"zoom"),
-    zoomLevel
-  );
+// everything but the toys for the most recently published frame
+void ParticleSystem::drawScene(
+  float zoomLevel,
+  float resX,
+  float resY
+){
+  frames.update();
+  ParticleFrame & f = frames.front();
+  uint64_t n = std::min(uint64_t(f.state.size()/3),nParticles);
+
+  // render one step behind, between the last two states, so motion
+  // is smooth whatever the ratio of step rate to frame rate
+  float alpha = 1.0;
+  if (f.interval > 0.0){
+    alpha = std::min(1.0,std::max(0.0,(wallClock()-f.time)/f.interval));
+  }
 
-  glUniform1f(
-    glGetUniformLocation(particleShader,"scale"),
-    resX*radius*2.0
-  );
+  if (f.previous.size() != f.state.size()){
+    alpha = 1.0;
+  }
+  drawnAlpha = alpha;
+
+  const float * a = alpha >= 1.0 ? f.state.data() : f.previous.data();
+  const float * b = f.state.data();
+
+  // points a pixel or less across are mostly wasted fill and
+  // upload, crossfade to the per cell density field instead
+  bool sorted = f.Nc > 0 && f.cellStart.size() == f.Nc*f.Nc+1;
+  float pointPixels = resX*radius*2.0*zoomLevel;
+  lodFade = 0.0;
+  if (sorted){
+    lodFade = std::min(1.0f,std::max(0.0f,(lodStartPixels-pointPixels)/(lodStartPixels-lodEndPixels)));
+  }
+
+  double tic = wallClock();
+  uploadTime = 0.0;
+  drawnParticles = 0;
+
+  if (lodFade > 0.0){
+    buildDensity(f,zoomLevel,resX);
+    uploadTime = wallClock()-tic;
+    drawDensity(lodFade);
+  }
+
+  if (lodFade >= 1.0){
+    telemetry().record(Metric::UPLOAD,uploadTime);
+    drawHeatmap(f);
+    return;
+  }
 
-  glBindBuffer(GL_ARRAY_BUFFER,offsetVBO);
-  glBufferSubData(GL_ARRAY_BUFFER,0,sizeof(float)*nParticles*3,&state[0]);
+  // only the cells overlapping the visible rectangle, padded so
+  // discs centred just off screen still get drawn
+  int64_t a0 = 0, a1 = -1, b0 = 0, b1 = -1;
+  if (sorted){
+    float pad = 2.0*radius;
+    float delta = 1.0/f.Nc;
+    int64_t last = int64_t(f.Nc)-1;
+    a0 = std::max(int64_t(0),int64_t(std::floor((visibleLower.x-pad)/delta)));
+    a1 = std::min(last,int64_t(std::floor((visibleUpper.x+pad)/delta)));
+    b0 = std::max(int64_t(0),int64_t(std::floor((visibleLower.y-pad)/delta)));
+    b1 = std::min(last,int64_t(std::floor((visibleUpper.y+pad)/delta)));
+  }
+
+  // same settled frame over the same cells, e.g paused, the instances
+  // from last time are still sitting in the current region
+  glm::ivec4 cells(a0,a1,b0,b1);
+  if (sorted && alpha >= 1.0 && f.step == uploadedStep && cells == uploadedCells){
+    drawnParticles = uploadedCount;
+    drawParticles(uploadedOffset,uploadedCount,zoomLevel,resX,1.0-lodFade);
+    drawHeatmap(f);
+    return;
+  }
+
+  tic = wallClock();
+  uint16_t * out = (uint16_t*)instances.map();
+  if (out == nullptr){
+    uploadedStep = ~uint64_t(0);
+    drawHeatmap(f);
+    return;
+  }
+  uint64_t drawn = 0;
+
+  if (!sorted){
+    packInstances(a,b,alpha,n,out);
+    drawn = n;
+  }
+  else{
+    // each row of cells is one range, runs of adjacent rows are merged
+    uint64_t rangeStart = 0, rangeEnd = 0;
+    for (int64_t r = a0; r <= a1 && b0 <= b1; r++){
+      uint64_t first = f.cellStart[r*f.Nc+b0];
+      uint64_t end = std::min(n,f.cellStart[r*f.Nc+b1+1]);
+      if (first != rangeEnd){
+        packInstances(a+rangeStart*3,b+rangeStart*3,alpha,rangeEnd-rangeStart,out+drawn*3);
+        drawn += rangeEnd-rangeStart;
+        rangeStart = first;
+      }
+      rangeEnd = end;
+    }
+    packInstances(a+rangeStart*3,b+rangeStart*3,alpha,rangeEnd-rangeStart,out+drawn*3);
+    drawn += rangeEnd-rangeStart;
+  }
+
+  uint64_t offset = instances.unmap();
+  uploadTime += wallClock()-tic;
+  telemetry().record(Metric::UPLOAD,uploadTime);
+  drawnParticles = drawn;
+  uploadedStep = alpha >= 1.0 ? f.step : ~uint64_t(0);
+  uploadedCells = cells;
+  uploadedOffset = offset;
+  uploadedCount = drawn;
+
+  drawParticles(offset,drawn,zoomLevel,resX,1.0-lodFade);
+  drawHeatmap(f);
+}
+
+void ParticleSystem::draw(
+  const float * frame,
+  uint64_t n,
+  uint64_t frameId,
+  float zoomLevel,
+  float resX,
+  float resY
+){
+  if (!glReady){initialiseGL();}
+  TraceScope trace("draw");
+  n = std::min(n,nParticles);                                                    // instances are sized for nParticles
+
+  double tic = wallClock();
+  uint16_t * out = (uint16_t*)instances.map();
+  if (out == nullptr){
+    drawnParticles = 0;
+    uploadedStep = ~uint64_t(0);
+    return;
+  }
+  packInstances(frame,frame,1.0,n,out);
+  uint64_t offset = instances.unmap();
+  uploadTime = wallClock()-tic;
+  telemetry().record(Metric::UPLOAD,uploadTime);
+  drawnParticles = n;
+  drawnAlpha = 1.0;
+  uploadedStep = ~uint64_t(0);
+  lodFade = 0.0;                                                                  // unsorted, no cells to build a field from
+
+  gpuTimers().begin(GPU_PARTICLES);
+  drawParticles(offset,n,zoomLevel,resX);
+  gpuTimers().end(GPU_PARTICLES);
+  gpuTimers().begin(GPU_TOYS);
+  drawToys(frameId,zoomLevel,resX);
+  gpuTimers().end(GPU_TOYS);
+  snapshotRenderMemory();
+}
+
+void ParticleSystem::drawParticles(
+  uint64_t offset,
+  uint64_t n,
+  float zoomLevel,
+  float resX,
+  float opacity
+){
+  glUseProgram(particleShader);
+
+  // point size comes from the shared Camera block
+  if (opacity != setParticleOpacity){
+    glUniform1f(particleOpacity,opacity);
+    setParticleOpacity = opacity;
+  }
+
+  glBindVertexArray(vertVAO);
+  // source this frame's region of the ring
+  glBindBuffer(GL_ARRAY_BUFFER,instances.id());
+  glVertexAttribPointer(1,3,GL_UNSIGNED_SHORT,GL_TRUE,3*sizeof(uint16_t),(void*)offset);
   glBindBuffer(GL_ARRAY_BUFFER,0);
 
   glError("particles buffers");
 
-  glBindVertexArray(vertVAO);
-  glDrawArraysInstanced(GL_POINTS,0,1,size());
+  glDrawArraysInstanced(GL_POINTS,0,1,n);
   glBindVertexArray(0);
+  instances.fence();
 
   glError("draw particles");
+}
 
-  glUseProgram(arShader);
+/*
+  Bin a sorted frame into a square RGBA8 texture: area fraction covered
+  and mean cos,sin theta per texel. A texel is k x k cells with k picked
+  so a texel is at least a pixel on screen, keeping the texture no
+  bigger than the window whatever the particle count. Rows of texels
+  are independent so they are built in parallel, and the whole thing
+  is skipped if neither the frame nor k has changed.
+*/
+void ParticleSystem::buildDensity(const ParticleFrame & f, float zoomLevel, float resX){
+  float cellPixels = resX*zoomLevel/f.Nc;
+  uint64_t k = cellPixels >= 1.0 ? 1 : uint64_t(std::ceil(1.0/cellPixels));
+  if (f.step == densityStep && k == densityCells){return;}
+
+  uint64_t Nc = f.Nc;
+  uint64_t size = (Nc+k-1)/k;
+  densityTexels.resize(size*size*4);
+
+  // theta/2PI to 8 bits indexes a table, no trig per particle
+  static float cosTable[256], sinTable[256];
+  static bool tabulated = false;
+  if (!tabulated){
+    for (int i = 0; i < 256; i++){
+      cosTable[i] = std::cos(2.0*M_PI*i/256.0);
+      sinTable[i] = std::sin(2.0*M_PI*i/256.0);
+    }
+    tabulated = true;
+  }
 
-  glUniform1f(
-    glGetUniformLocation(arShader,"zoom"),
-    zoomLevel
+  const float * s = f.state.data();
+  const float inv2Pi = 1.0/(2.0*M_PI);
+  float disc = M_PI*radius*radius;
+  float cellArea = 1.0/(float(Nc)*float(Nc));
+  uint8_t * texels = densityTexels.data();
+
+  parallelFor(
+    0,
+    size,
+    [&](uint64_t first, uint64_t last, unsigned thread){
+      for (uint64_t ta = first; ta < last; ta++){
+        uint64_t a1 = std::min(Nc,(ta+1)*k);
+        for (uint64_t tb = 0; tb < size; tb++){
+          uint64_t b0 = tb*k;
+          uint64_t b1 = std::min(Nc,b0+k);
+          uint64_t count = 0;
+          float c = 0.0, sn = 0.0;
+          for (uint64_t a = ta*k; a < a1; a++){
+            // a run of cells along b is one range of the sorted frame
+            uint64_t p0 = f.cellStart[a*Nc+b0];
+            uint64_t p1 = f.cellStart[a*Nc+b1];
+            for (uint64_t p = p0; p < p1; p++){
+              uint8_t q = uint8_t(int32_t(s[p*3+2]*inv2Pi*256.0f));
+              c += cosTable[q];
+              sn += sinTable[q];
+            }
+            count += p1-p0;
+          }
+          uint8_t * t = texels+(tb*size+ta)*4;                                    // x along texture rows
+          float coverage = count*disc/((a1-ta*k)*(b1-b0)*cellArea);
+          float norm = count > 0 ? 1.0/count : 0.0;
+          t[0] = uint8_t(std::min(coverage,1.0f)*255.0f);
+          t[1] = uint8_t((c*norm*0.5f+0.5f)*255.0f);
+          t[2] = uint8_t((sn*norm*0.5f+0.5f)*255.0f);
+          t[3] = 255;
+        }
+      }
+    }
   );
 
-  glUniform1f(
-    glGetUniformLocation(arShader,"scale"),
-    radius*8.0*resX*2.0
-  );
+  glBindTexture(GL_TEXTURE_2D,densityTexture);
+  if (size != densitySize){
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,size,size,0,GL_RGBA,GL_UNSIGNED_BYTE,texels);
+    densitySize = size;
+  }
+  else{
+    glTexSubImage2D(GL_TEXTURE_2D,0,0,0,size,size,GL_RGBA,GL_UNSIGNED_BYTE,texels);
+  }
+  glBindTexture(GL_TEXTURE_2D,0);
 
-  glUniform1f(
-    glGetUniformLocation(arShader,"t"),
-    frameId % ARPERIOD
-  );
+  densityCells = k;
+  densityStep = f.step;
 
-  glUniform1i(
-    glGetUniformLocation(arShader,"na"),
-    attractors.size()
-  );
+  glError("density texture");
+}
 
-  glUniform1i(
-    glGetUniformLocation(arShader,"nr"),
-    repellers.size()
-  );
+void ParticleSystem::drawDensity(float opacity){
+  glUseProgram(densityShader);
 
-  glm::mat4 A = attractionRepulsionMatrix(attractors,8);
-  glm::mat4 R = attractionRepulsionMatrix(repellers,8);
+  // the last row and column of texels may run past the box
+  float extent = float(densitySize*densityCells)/float(Nc);
+  if (extent != setDensityExtent){
+    glUniform2f(densityExtent,extent,extent);
+    setDensityExtent = extent;
+  }
 
-  glUniformMatrix4fv(
-    glGetUniformLocation(arShader,"attr"),
-    1,
-    GL_FALSE,
-    &A[0][0]
-  );
+  if (opacity != setDensityOpacity){
+    glUniform1f(densityOpacity,opacity);
+    setDensityOpacity = opacity;
+  }
 
-  glUniformMatrix4fv(
-    glGetUniformLocation(arShader,"rep"),
-    1,
-    GL_FALSE,
-    &R[0][0]
-  );
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D,densityTexture);
+  glBindVertexArray(densityVAO);
+  glDrawArrays(GL_TRIANGLE_STRIP,0,4);
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D,0);
 
-  glBindBuffer(GL_ARRAY_BUFFER,arOffsetVBO);
-  glBufferSubData(GL_ARRAY_BUFFER,0,sizeof(float)*16,&arOffsets[0]);
-  glBindBuffer(GL_ARRAY_BUFFER,0);
+  glError("draw density");
+}
+
+void ParticleSystem::drawHeatmap(const ParticleFrame & f){
+  if (f.heatmap == HEATMAP_OFF || f.cellLoad.size() != f.Nc*f.Nc){return;}
+
+  if (f.step != heatmapStep || f.heatmap != heatmapBuilt){
+    uint64_t cells = f.Nc*f.Nc;
+    uint32_t peak = std::max(uint32_t(1),*std::max_element(f.cellLoad.begin(),f.cellLoad.end()));
+    // pair tests go with occupancy squared, a log scale keeps the rest visible
+    bool logScale = f.heatmap == HEATMAP_PAIRS;
+    float scale = logScale ? 1.0/std::log(1.0+peak) : 1.0/peak;
+
+    heatmapTexels.resize(cells*4);
+    for (uint64_t a = 0; a < f.Nc; a++){
+      for (uint64_t b = 0; b < f.Nc; b++){
+        uint32_t v = f.cellLoad[a*f.Nc+b];
+        uint8_t * t = heatmapTexels.data()+(b*f.Nc+a)*4;                          // x along texture rows
+        if (v == 0){
+          t[0] = t[1] = t[2] = t[3] = 0;
+          continue;
+        }
+        float x = logScale ? std::log(1.0+v)*scale : v*scale;
+        // blue through yellow to red
+        float r, g, bl;
+        if (x < 0.5){
+          r = 0.1+1.8*x; g = 0.3+1.2*x; bl = 0.9-1.6*x;
+        }
+        else{
+          r = 1.0-0.2*(x-0.5); g = 0.9-1.6*(x-0.5); bl = 0.1;
+        }
+        t[0] = uint8_t(r*255.0f);
+        t[1] = uint8_t(g*255.0f);
+        t[2] = uint8_t(bl*255.0f);
+        t[3] = 160;
+      }
+    }
+
+    glBindTexture(GL_TEXTURE_2D,heatmapTexture);
+    if (f.Nc != heatmapSize){
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,f.Nc,f.Nc,0,GL_RGBA,GL_UNSIGNED_BYTE,heatmapTexels.data());
+      heatmapSize = f.Nc;
+    }
+    else{
+      glTexSubImage2D(GL_TEXTURE_2D,0,0,0,f.Nc,f.Nc,GL_RGBA,GL_UNSIGNED_BYTE,heatmapTexels.data());
+    }
+    glBindTexture(GL_TEXTURE_2D,0);
+    heatmapStep = f.step;
+    heatmapBuilt = f.heatmap;
+  }
+
+  glUseProgram(heatmapShader);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D,heatmapTexture);
+  glBindVertexArray(densityVAO);
+  glDrawArrays(GL_TRIANGLE_STRIP,0,4);
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D,0);
+
+  glError("draw heatmap");
+}
+
+void ParticleSystem::drawToys(
+  uint64_t frameId,
+  float zoomLevel,
+  float resX
+){
+  // toys as of the last published step, the physics thread owns the live ones
+  ParticleFrame & toys = frames.front();
+  if (toys.attractors.empty() && toys.repellers.empty()){return;}
+
+  glUseProgram(arShader);
+
+  // point size comes from the shared Camera block
+  float t = frameId % ARPERIOD;
+  if (t != setToyT){
+    glUniform1f(arT,t);
+    setToyT = t;
+  }
+
+  // uniforms stick with the program, only rebuilt after an edit
+  if (toys.toyEdits != drawnToyEdits){
+    glUniform1i(arNA,toys.attractors.size());
+    glUniform1i(arNR,toys.repellers.size());
+
+    glm::mat4 A = attractionRepulsionMatrix(toys.attractors,8);
+    glm::mat4 R = attractionRepulsionMatrix(toys.repellers,8);
+
+    glUniformMatrix4fv(arAttr,1,GL_FALSE,&A[0][0]);
+    glUniformMatrix4fv(arRep,1,GL_FALSE,&R[0][0]);
+    drawnToyEdits = toys.toyEdits;
+  }
 
   glBindVertexArray(arVAO);
   glDrawArraysInstanced(GL_POINTS,0,1,16);
@@ -1,63 +1,151 @@
 #ifndef PARTICLE_SYSTEM_H
 #define PARTICLE_SYSTEM_H
 
-const uint64_t NULL_INDEX = uint64_t(-1);
 const int ARPERIOD = 60;
 const float attractionStrength = 0.01;
 const float repellingStrength = 0.02;
+// on screen particle diameters (pixels) over which points crossfade to the density field,
+// below the stock view's 1.8 px (10^5 particles, density 0.5) so it draws plain points
+const float lodStartPixels = 1.0;
+const float lodEndPixels = 0.5;
+
+// what the cell grid overlay shows, if anything
+enum HeatmapMode : uint8_t {
+  HEATMAP_OFF,
+  HEATMAP_OCCUPANCY,                                                              // particles per cell
+  HEATMAP_PAIRS,                                                                  // pair tests per cell in the sweep
+  HEATMAP_MODES
+};
 
 #include <vector>
+#include <algorithm>
 #include <time.h>
 #include <math.h>
 #include <random>
 #include <iostream>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <memory>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shaders.h>
 #include <glUtils.h>
-
-std::default_random_engine generator;
-std::uniform_real_distribution<float> U(0.0,1.0);
-std::normal_distribution<double> normal(0.0,1.0);
+#include <shaderManager.h>
+#include <gpuTimer.h>
+#include <tripleBuffer.h>
+#include <streamBuffer.h>
+#include <parallel.h>
+#include <telemetry.h>
+#include <trace.h>
+#include <perfCounters.h>
+#include <ParticleSystem/stats.h>
+#include <memoryStats.h>
+
+#include <CellList/cellList.h>
+#include <SharedMemory/sharedFrames.h>
+
+/*
+  A completed step, as handed from the physics thread to the renderer.
+
+  Particles are sorted by cell, those in cell a*Nc+b are
+  [cellStart[a*Nc+b],cellStart[a*Nc+b+1]), so any run of cells
+  along b is one contiguous range of the arrays.
+*/
+struct ParticleFrame {
+  std::vector<float> state;
+  std::vector<float> previous;                                                    // state one step earlier
+  std::vector<uint64_t> cellStart;
+  uint64_t Nc = 0;
+  double time = 0.0;                                                              // wallClock() time state belongs to
+  double interval = 0.0;                                                          // wall time between previous and state
+  std::vector<std::pair<float,float>> attractors;
+  std::vector<std::pair<float,float>> repellers;
+  uint64_t toyEdits = 0;                                                          // bumped whenever the toys change
+  uint64_t step = 0;
+  uint8_t heatmap = HEATMAP_OFF;
+  std::vector<uint32_t> cellLoad;                                                 // per cell, as cells[a*Nc+b], for the heatmap
+};
 
 class ParticleSystem{
 public:
 
   ParticleSystem(uint64_t N, float dt = 1.0/120.0, float density = 0.5, uint64_t seed = clock())
-  : nParticles(N), radius(std::sqrt(density/(N*M_PI))),speed(std::sqrt(density/(N*M_PI))/0.2),drag(1.0),rotationalDrag(1.0),mass(0.1),
+  : ParticleSystem(N,nullptr,dt,density,seed) {}
+
+  // start from N x,y,theta triples (e.g a loaded configuration) instead of random placement
+  ParticleSystem(uint64_t N, const float * initial, float dt = 1.0/120.0, float density = 0.5, uint64_t seed = clock())
+  : nParticles(N), density(density), radius(std::sqrt(density/(N*M_PI))),speed(std::sqrt(density/(N*M_PI))/0.2),drag(1.0),rotationalDrag(1.0),mass(0.1),
     momentOfInertia(0.01), forceStrength(300.0),rotationalDiffusion(0.001),
     dt(dt)
   {
     generator.seed(seed);
     Nc = std::ceil(1.0/(4.0*radius));
-    delta = 1.0 / Nc;
-
-    for (int c = 0; c < Nc*Nc; c++){
-      cells.push_back(NULL_INDEX);
+    cellList = CellList(Nc,N);
+
+    // sized once up front, growing by push_back is minutes at 10^7 particles
+    state.resize(N*3);
+    forces.assign(N*2,0.0);
+    noise.assign(N*2,0.0);
+
+    if (initial == nullptr){
+      for (int i = 0; i < N; i++){
+        state[i*3] = U(generator)*(1.0-2*radius)+radius;
+        state[i*3+1] = U(generator)*(1.0-2*radius)+radius;
+        state[i*3+2] = U(generator)*2.0*3.14;
+      }
+    }
+    else{
+      std::copy(initial,initial+N*3,state.begin());
     }
 
-    for (int i = 0; i < N; i++){
-      float x = U(generator)*(1.0-2*radius)+radius;
-      float y = U(generator)*(1.0-2*radius)+radius;
-      float theta = U(generator)*2.0*3.14;
-
-      addParticle(x,y,theta);
-      uint64_t c = hash(i);
-      if (cells[c] == NULL_INDEX){
-        cells[c] = i;
-      }
-      else{
-        insert(cells[c],uint64_t(i));
-      }
+    // one pass to keep everyone inside the walls and bin them
+    for (uint64_t i = 0; i < N; i++){
+      state[i*3] = std::min(std::max(state[i*3],radius),float(1.0-radius));
+      state[i*3+1] = std::min(std::max(state[i*3+1],radius),float(1.0-radius));
+      cellList.insert(hash(i),i);
     }
-    initialiseGL();
+    lastState = state;
+
+    publish();
+    hostMemory(memoryLocal);
+    memorySnapshot = memoryLocal;
   }
 
   void step();
+  // hand the current state and toys to the renderer, lock free. The renderer
+  // interpolates from the previous step to this one over interval seconds
+  // ending at wall time (0 interval for no interpolation)
+  void publish(double time = 0.0, double interval = 0.0);
+  uint64_t getSteps(){return steps;}
+
+  // count cycles, instructions, LLC and branch misses per step phase,
+  // opened on the stepping thread at its next step
+  void enableCounters(bool e){countersWanted = e;}
+  // from now on copy every n'th step's state into the named POSIX shared
+  // memory ring (see SharedFrames), false if it could not be made
+  bool shareFrames(std::string name, uint64_t every = 1, uint32_t slots = 4);
+  // a copy of the totals from the last step, safe from any thread
+  SimulationStats getStats(){
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return statsSnapshot;
+  }
+
+  // adding extra particles would move the per particle arrays
+  bool willReallocate(uint64_t extra){
+    return state.size()+3*extra > state.capacity() || lastState.size()+3*extra > lastState.capacity() ||
+      forces.size()+2*extra > forces.capacity() || noise.size()+2*extra > noise.capacity();
+  }
 
   void addParticle(float x, float y, float theta){
+    if (willReallocate(1)){
+      // every array is copied, briefly holding old and new at once
+      std::cout << "addParticle reallocating per particle arrays at " << size() << " particles ("
+        << formatBytes((state.capacity()+lastState.capacity())*sizeof(float)+(forces.capacity()+noise.capacity())*sizeof(float))
+        << " to copy)\n";
+    }
     state.push_back(x);
     state.push_back(y);
     state.push_back(theta);
@@ -71,8 +159,6 @@ public:
 
     noise.push_back(0.0);
     noise.push_back(0.0);
-
-    list.push_back(NULL_INDEX);
   }
 
   void removeParticle(uint64_t i){
@@ -97,7 +183,7 @@ public:
         noise.begin()+2*i+1
       );
 
-      list.erase(list.begin()+i);
+      cellList.resize(size());
     }
   }
 
@@ -105,31 +191,71 @@ public:
     return uint64_t(std::floor(state.size() / 3));
   }
 
+  // every sizeable allocation, host and GPU, and the process' RSS, from
+  // copies the stepping thread (each step) and render thread (each draw)
+  // leave, safe from any thread
+  MemoryReport memory();
+
+  const float * getState(){return &state[0];}
+  float getRadius(){return radius;}
+  float getDensity(){return density;}
+  float getDt(){return dt;}
+
   uint8_t nAttractors(){return uint8_t(attractors.size());}
   uint8_t nRepellers(){return uint8_t(repellers.size());}
 
   void addRepeller(float x, float y);
   void addAttractor(float x, float y);
   bool deleteAttratorRepellor(float x, float y);
-  // GL public members
-  void setProjection(glm::mat4 p);
+  // GL public members, the camera is shaderManager().setCamera()
+  // world space rectangle on screen, only cells overlapping it are drawn
+  void setVisibleRegion(glm::vec2 lower, glm::vec2 upper){
+    visibleLower = lower;
+    visibleUpper = upper;
+  }
+  uint64_t getDrawnParticles(){return drawnParticles;}
+  // a frame has been published since the last draw, or the last draw was
+  // still interpolating towards one
+  bool needsRedraw(){return frames.fresh() || drawnAlpha < 1.0;}
+  // colour the cell grid by load, from the next step published
+  void setHeatmap(uint8_t mode){heatmapMode = mode;}
+  uint8_t getHeatmap(){return heatmapMode;}
+  // 0 all points, 1 all density field
+  float getLodFade(){return lodFade;}
+  // seconds spent writing the last frame's instances or density texture
+  double getUploadTime(){return uploadTime;}
+  // draws the most recently published frame
   void draw(uint64_t frameId, float zoomLevel, float resX, float resY);
+  // draw n particles from an external x,y,theta buffer, e.g a trajectory frame
+  void draw(const float * frame, uint64_t n, uint64_t frameId, float zoomLevel, float resX, float resY);
 
   ~ParticleSystem(){
+    if (!glReady){return;}
     // kill some GL stuff
     glDeleteProgram(particleShader);
     glDeleteProgram(arShader);
+    glDeleteProgram(densityShader);
+    glDeleteProgram(heatmapShader);
 
-    glDeleteBuffers(1,&offsetVBO);
     glDeleteBuffers(1,&vertVBO);
     glDeleteBuffers(1,&arOffsetVBO);
+    glDeleteBuffers(1,&densityVBO);
+
+    glDeleteTextures(1,&densityTexture);
+    glDeleteTextures(1,&heatmapTexture);
 
     glDeleteVertexArrays(1,&vertVAO);
     glDeleteVertexArrays(1,&arVAO);
+    glDeleteVertexArrays(1,&densityVAO);
   }
 
 private:
 
+  // each system draws from its own stream, so several can step side by side
+  std::default_random_engine generator;
+  std::uniform_real_distribution<float> U{0.0,1.0};
+  std::normal_distribution<double> normal{0.0,1.0};
+
   std::vector<float> state;
   std::vector<float> lastState;
   std::vector<float> noise;
@@ -138,13 +264,34 @@ private:
   std::vector<std::pair<float,float>> attractors;
   std::vector<std::pair<float,float>> repellers;
 
-  std::vector<uint64_t> cells;
-  std::vector<uint64_t> list;
-
+  TripleBuffer<ParticleFrame> frames;
+  uint64_t steps = 0;
+  uint64_t toyEdits = 0;
+
+  // only the stepping thread touches stats, readers get statsSnapshot
+  SimulationStats stats;
+  SimulationStats statsSnapshot;
+  MemoryReport memoryLocal;                                                       // host arrays, stepping thread's copy
+  bool memoryChanged = false;                                                     // since memorySnapshot was last taken
+  MemoryReport memorySnapshot;                                                    // host arrays, taken with statsSnapshot
+  std::mutex statsMutex;
+  std::vector<MemoryEntry> renderMemory;                                          // what draw() holds, host and GPU
+  std::mutex renderMemoryMutex;
+  PerfCounters counters;
+  std::atomic<bool> countersWanted{false};
+  bool countersOpen = false;
+  double phaseTic = 0.0;
+  PerfSample phaseCounters;
+  std::atomic<uint8_t> heatmapMode{HEATMAP_OFF};
+  std::unique_ptr<SharedFrames> shared;
+  uint64_t shareEvery = 1;
+  std::vector<uint32_t> cellPairs;                                                // last step's pair tests per cell, for the heatmap
+
+  CellList cellList;
   uint64_t Nc;
-  float delta;
 
   uint64_t nParticles;
+  float density;
 
   float forceStrength;
   float rotationalDiffusion;
@@ -156,18 +303,46 @@ private:
   float momentOfInertia;
   float dt;
 
-  // GL data members
-  GLuint particleShader, offsetVBO, vertVAO, vertVBO;
-  glm::mat4 projection;
-  glm::mat4 arPositions;
+  // GL data members, created on the first draw so headless runs need no context
+  bool glReady = false;
+  GLuint particleShader, vertVAO, vertVBO;
+  StreamBuffer instances;
+  double uploadTime = 0.0;
+  glm::vec2 visibleLower = glm::vec2(0.0,0.0);
+  glm::vec2 visibleUpper = glm::vec2(1.0,1.0);
+  uint64_t drawnParticles = 0;
+  float drawnAlpha = 1.0;
+  // what the current instance region holds, redrawn as is if nothing changed
+  uint64_t uploadedStep = ~uint64_t(0);
+  glm::ivec4 uploadedCells = glm::ivec4(-1);
+  uint64_t uploadedOffset = 0;
+  uint64_t uploadedCount = 0;
+  uint64_t drawnToyEdits = ~uint64_t(0);
+  std::vector<uint64_t> sortCell, sortNext;                                      // publish() counting sort scratch
 
   GLuint arShader, arOffsetVBO, arVAO;
 
+  GLuint densityShader, densityVAO, densityVBO, densityTexture;
+  std::vector<uint8_t> densityTexels;
+  uint64_t densitySize = 0;                                                       // texels per side allocated on the GPU
+  uint64_t densityCells = 0;                                                      // cells per texel side it was built with
+  uint64_t densityStep = ~uint64_t(0);                                            // frame it was built from
+  float lodFade = 0.0;
+
+  GLuint heatmapShader, heatmapTexture;
+  std::vector<uint8_t> heatmapTexels;
+  uint64_t heatmapSize = 0;                                                       // texels per side allocated on the GPU
+  uint64_t heatmapStep = ~uint64_t(0);                                            // frame it was built from
+  uint8_t heatmapBuilt = HEATMAP_OFF;
+
+  // uniform locations, resolved once
+  GLint particleOpacity, arT, arNA, arNR, arAttr, arRep, densityExtent, densityOpacity, heatmapExtent;
+  // values last set, uniforms keep them between draws
+  float setParticleOpacity = -1.0, setToyT = -1.0, setDensityExtent = -1.0, setDensityOpacity = -1.0;
+
   float vertices[3] = {0.0,0.0,0.0};
   float arOffsets[16];
 
-  void resetLists();
-  void insert(uint64_t next, uint64_t particle);
   void populateLists();
   void handleCollision(uint64_t i, uint64_t j);
   void cellCollisions(
@@ -178,13 +353,24 @@ private:
   );
 
   uint64_t hash(uint64_t particle){
-    return uint64_t(floor(state[particle*3]/delta))*Nc + uint64_t(floor(state[particle*3+1]/delta));
+    return cellList.hash(state[particle*3],state[particle*3+1]);
   }
 
   void fillARMatrix();
+  void measureLoad();
+  bool hostMemory(MemoryReport & r);
+  void snapshotRenderMemory();
+  void beginPhases();
+  void endPhase(StepPhase p);
 
   // GL private members
   void initialiseGL();
+  void drawScene(float zoomLevel, float resX, float resY);
+  void drawParticles(uint64_t offset, uint64_t n, float zoomLevel, float resX, float opacity = 1.0);
+  void buildDensity(const ParticleFrame & f, float zoomLevel, float resX);
+  void drawDensity(float opacity);
+  void drawHeatmap(const ParticleFrame & f);
+  void drawToys(uint64_t frameId, float zoomLevel, float resX);
 };
 
 #endif
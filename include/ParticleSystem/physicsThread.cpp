@@ -0,0 +1,106 @@
+#include <ParticleSystem/physicsThread.h>
+
+// substeps per publish before the renderer is given a frame regardless
+const uint64_t maxSubsteps = 16;
+// beyond this much debt (seconds) the simulation cannot catch up, skip ahead
+const double maxLag = 0.5;
+
+PhysicsThread::PhysicsThread(
+  ParticleSystem & particles,
+  uint8_t maxAttractors,
+  uint8_t maxRepellors,
+  double stepInterval,
+  std::function<void(ParticleSystem &)> onStep
+)
+: particles(particles), maxAttractors(maxAttractors), maxRepellors(maxRepellors),
+  stepInterval(stepInterval), onStep(onStep), running(true), paused(false), unlimited(false),
+  stepCount(0), lastStepTime(0.0), lastSubsteps(0), resets(0)
+{
+  worker = std::thread(&PhysicsThread::loop,this);
+}
+
+void PhysicsThread::stop(){
+  if (!running){return;}
+  running = false;
+  commands.interrupt();
+  worker.join();
+}
+
+void PhysicsThread::apply(ToyCommand & c){
+  if (particles.deleteAttratorRepellor(c.x,c.y)){
+    return;
+  }
+  if (c.repellor && particles.nRepellers() < maxRepellors){
+    particles.addRepeller(c.x,c.y);
+  }
+  else if (c.attractor && particles.nAttractors() < maxAttractors){
+    particles.addAttractor(c.x,c.y);
+  }
+}
+
+void PhysicsThread::loop(){
+  tracer().nameThread("physics");
+  std::vector<ToyCommand> pending;
+  // the wall time the simulation has caught up to
+  double simTime = wallClock();
+
+  while (running){
+    bool edited;
+    if (paused){
+      // nothing to do until an edit, unpause or stop arrives
+      edited = commands.wait(pending,std::chrono::milliseconds(100));
+      for (uint64_t i = 0; i < pending.size(); i++){apply(pending[i]);}
+      if (edited){particles.publish();}                                           // show the toy edit while paused
+      simTime = wallClock();                                                      // no catching up on the pause
+      continue;
+    }
+
+    uint64_t n = 1;
+    if (unlimited){
+      commands.drain(pending);
+    }
+    else{
+      double behind = wallClock()-simTime;
+      if (behind < stepInterval){
+        // not due yet, but stay responsive to edits while we wait
+        commands.wait(pending,std::chrono::duration<double>(stepInterval-behind));
+        for (uint64_t i = 0; i < pending.size(); i++){apply(pending[i]);}
+        continue;
+      }
+      commands.drain(pending);
+      if (behind > maxLag){
+        // hopelessly behind, step once and let wall time go
+        simTime = wallClock()-stepInterval;
+        resets++;
+      }
+      else{
+        n = std::min(maxSubsteps,uint64_t(behind/stepInterval));
+      }
+    }
+
+    for (uint64_t i = 0; i < pending.size(); i++){
+      apply(pending[i]);
+    }
+
+    for (uint64_t k = 0; k < n; k++){
+      double tic = wallClock();
+      particles.step();
+      lastStepTime = wallClock()-tic;
+      telemetry().record(Metric::PHYSICS,lastStepTime);
+      stepCount++;
+      if (onStep){onStep(particles);}
+    }
+    lastSubsteps = n;
+
+    if (unlimited){
+      double now = wallClock();
+      particles.publish(now,now-simTime);
+      simTime = now;
+    }
+    else{
+      // anything over maxSubsteps stays owed and is run next time around
+      simTime += n*stepInterval;
+      particles.publish(simTime,stepInterval);
+    }
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef PHYSICSTHREAD_H
+#define PHYSICSTHREAD_H
+
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+
+#include <ParticleSystem/particleSystem.h>
+#include <commandQueue.h>
+
+// a left click in world space, applied between steps
+struct ToyCommand {
+  float x;
+  float y;
+  bool attractor;                                                                 // placing an attractor
+  bool repellor;                                                                  // placing a repellor
+};
+
+/*
+  Steps a ParticleSystem on its own thread, publishing completed
+  steps for the renderer. Edits to the toys are queued and applied
+  at step boundaries so the render thread never touches live
+  simulation state.
+
+  By default steps are paced to wall time, one step every
+  stepInterval seconds: as many substeps are run as the elapsed
+  time needs and simulated time never drifts with the frame rate.
+  Unlimited mode steps flat out instead.
+*/
+class PhysicsThread {
+public:
+
+  PhysicsThread(
+    ParticleSystem & particles,
+    uint8_t maxAttractors,
+    uint8_t maxRepellors,
+    double stepInterval,
+    std::function<void(ParticleSystem &)> onStep = nullptr
+  );
+
+  ~PhysicsThread(){stop();}
+
+  void push(ToyCommand c){commands.push(c);}
+
+  void setPaused(bool p){
+    paused = p;
+    commands.interrupt();
+  }
+  bool isPaused(){return paused;}
+
+  void setUnlimited(bool u){
+    unlimited = u;
+    commands.interrupt();
+  }
+  bool isUnlimited(){return unlimited;}
+
+  uint64_t steps(){return stepCount;}
+  // wall time of the last step in seconds
+  double stepTime(){return lastStepTime;}
+  // substeps run before the last publish
+  uint64_t substeps(){return lastSubsteps;}
+  // times the simulation fell so far behind wall time it had to skip ahead
+  uint64_t lagResets(){return resets;}
+
+  void stop();
+
+private:
+
+  void loop();
+  void apply(ToyCommand & c);
+
+  ParticleSystem & particles;
+  uint8_t maxAttractors;
+  uint8_t maxRepellors;
+  double stepInterval;
+  std::function<void(ParticleSystem &)> onStep;
+
+  CommandQueue<ToyCommand> commands;
+
+  std::atomic<bool> running;
+  std::atomic<bool> paused;
+  std::atomic<bool> unlimited;
+  std::atomic<uint64_t> stepCount;
+  std::atomic<double> lastStepTime;
+  std::atomic<uint64_t> lastSubsteps;
+  std::atomic<uint64_t> resets;
+
+  std::thread worker;
+};
+
+#endif
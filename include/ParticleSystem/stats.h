@@ -0,0 +1,108 @@
+#ifndef SIMULATION_STATS_H
+#define SIMULATION_STATS_H
+
+#include <cstdint>
+#include <ostream>
+
+#include <perfCounters.h>
+
+enum StepPhase {
+  PHASE_CELLS,                                                                    // clearing forces, building the cell list
+  PHASE_COLLISIONS,                                                               // the pair sweep over neighbouring cells
+  PHASE_INTEGRATE,                                                                // toys, noise and the position update
+  STEP_PHASES
+};
+
+inline const char * stepPhaseName(StepPhase p){
+  switch (p){
+    case PHASE_CELLS: return "cells";
+    case PHASE_COLLISIONS: return "collisions";
+    case PHASE_INTEGRATE: return "integrate";
+    default: return "unknown";
+  }
+}
+
+inline const char * perfCounterName(PerfCounter c){
+  switch (c){
+    case CYCLES: return "cycles";
+    case INSTRUCTIONS: return "instructions";
+    case LLC_MISSES: return "llc_misses";
+    case BRANCH_MISSES: return "branch_misses";
+    default: return "unknown";
+  }
+}
+
+// cells holding 0,1,...,OCCUPANCY_BINS-2 particles, the last bin any more
+const uint8_t OCCUPANCY_BINS = 17;
+// cells by pair tests, bin 0 for none and bin k for [2^(k-1),2^k), the last any more
+const uint8_t PAIR_BINS = 24;
+
+// the cell grid after the last step, where the pair sweep's work goes
+struct CellLoad {
+  uint64_t cells = 0;
+  uint64_t occupied = 0;
+  uint64_t maxOccupancy = 0;
+  uint64_t pairTests = 0;                                                         // pairs the sweep tested in the step
+  uint64_t maxCellPairTests = 0;
+  uint64_t occupancyHistogram[OCCUPANCY_BINS] = {0};
+  uint64_t pairHistogram[PAIR_BINS] = {0};
+};
+
+struct PhaseStats {
+  uint64_t calls = 0;
+  double seconds = 0.0;
+  PerfSample counters;
+};
+
+// totals since the ParticleSystem was made, see ParticleSystem::getStats()
+struct SimulationStats {
+  uint64_t steps = 0;
+  uint64_t particles = 0;
+  bool haveCounter[PERF_COUNTERS] = {false,false,false,false};
+  PhaseStats phases[STEP_PHASES];
+  CellLoad load;
+
+  bool counters() const {
+    for (uint8_t c = 0; c < PERF_COUNTERS; c++){
+      if (haveCounter[c]){return true;}
+    }
+    return false;
+  }
+};
+
+// per phase times and, where counted, IPC and events per particle step,
+// then the cell load
+inline void writeStatsJSON(std::ostream & out, const SimulationStats & s){
+  out << "{\"steps\":" << s.steps << ",\"particles\":" << s.particles
+    << ",\"counters\":" << (s.counters() ? "true" : "false") << ",\"phases\":{";
+  for (uint8_t p = 0; p < STEP_PHASES; p++){
+    const PhaseStats & phase = s.phases[p];
+    double calls = phase.calls > 0 ? double(phase.calls) : 1.0;
+    double particleSteps = calls*(s.particles > 0 ? s.particles : 1);
+    out << (p == 0 ? "" : ",") << "\"" << stepPhaseName(StepPhase(p)) << "\":{"
+      << "\"seconds_per_step\":" << phase.seconds/calls;
+    const uint64_t * c = phase.counters.counts;
+    if (s.haveCounter[CYCLES] && s.haveCounter[INSTRUCTIONS]){
+      out << ",\"ipc\":" << (c[CYCLES] > 0 ? double(c[INSTRUCTIONS])/c[CYCLES] : 0.0);
+    }
+    for (uint8_t k = 0; k < PERF_COUNTERS; k++){
+      if (!s.haveCounter[k]){continue;}
+      out << ",\"" << perfCounterName(PerfCounter(k)) << "_per_particle\":" << c[k]/particleSteps;
+    }
+    out << "}";
+  }
+  const CellLoad & l = s.load;
+  out << "},\"cells\":{\"cells\":" << l.cells << ",\"occupied\":" << l.occupied
+    << ",\"max_occupancy\":" << l.maxOccupancy << ",\"pair_tests\":" << l.pairTests
+    << ",\"max_cell_pair_tests\":" << l.maxCellPairTests << ",\"occupancy_histogram\":[";
+  for (uint8_t b = 0; b < OCCUPANCY_BINS; b++){
+    out << (b == 0 ? "" : ",") << l.occupancyHistogram[b];
+  }
+  out << "],\"pair_histogram\":[";
+  for (uint8_t b = 0; b < PAIR_BINS; b++){
+    out << (b == 0 ? "" : ",") << l.pairHistogram[b];
+  }
+  out << "]}}";
+}
+
+#endif
@@ -0,0 +1,184 @@
+#include <SharedMemory/sharedFrames.h>
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+SharedFrames::SharedFrames(
+  std::string name,
+  uint64_t nParticles,
+  uint32_t nSlots,
+  float dt,
+  float density,
+  float radius,
+  uint32_t stepsPerFrame
+)
+: name(sharedMemoryName(name)), data(nullptr), length(0), header(nullptr)
+{
+  uint64_t page = sysconf(_SC_PAGESIZE);
+  auto pages = [page](uint64_t bytes){return (bytes+page-1)/page*page;};
+  nSlots = std::max(nSlots,uint32_t(2));
+  uint64_t headerBytes = pages(sizeof(SharedFramesHeader));
+  uint64_t slotBytes = pages(sizeof(SharedSlotHeader)+nParticles*3*sizeof(float));
+  uint64_t size = headerBytes+nSlots*slotBytes;
+
+  int fd = shm_open(this->name.c_str(),O_CREAT|O_EXCL|O_RDWR,0644);
+  if (fd < 0 && errno == EEXIST){
+    if (!staleSegment(this->name)){
+      std::cout << "Shared memory name " << this->name << " in use by a running writer\n";
+      return;
+    }
+    // left by a finished or crashed run, a live reader keeps its old view
+    shm_unlink(this->name.c_str());
+    fd = shm_open(this->name.c_str(),O_CREAT|O_EXCL|O_RDWR,0644);
+  }
+  if (fd < 0){
+    std::cout << "Could not create shared memory " << this->name << ": " << std::strerror(errno) << "\n";
+    return;
+  }
+  if (ftruncate(fd,size) != 0){
+    std::cout << "Could not size shared memory " << this->name << " to " << size << " bytes: " << std::strerror(errno) << "\n";
+    ::close(fd);
+    shm_unlink(this->name.c_str());
+    return;
+  }
+  void * map = mmap(nullptr,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+  ::close(fd);
+  if (map == MAP_FAILED){
+    std::cout << "Could not map shared memory " << this->name << "\n";
+    shm_unlink(this->name.c_str());
+    return;
+  }
+  data = static_cast<uint8_t*>(map);
+  length = size;
+
+  // fresh pages are zero, so every sequence starts even and nothing is published
+  header = reinterpret_cast<SharedFramesHeader*>(data);
+  std::memcpy(header->magic,SHARED_FRAMES_MAGIC,sizeof(header->magic));
+  header->version = SHARED_FRAMES_VERSION;
+  header->stride = 3;
+  header->nParticles = nParticles;
+  header->nSlots = nSlots;
+  header->headerBytes = uint32_t(headerBytes);
+  header->slotBytes = slotBytes;
+  header->dataOffset = sizeof(SharedSlotHeader);
+  header->dt = dt;
+  header->density = density;
+  header->radius = radius;
+  header->stepsPerFrame = stepsPerFrame;
+  header->writer = uint64_t(getpid());
+  header->published.store(0,std::memory_order_release);
+}
+
+// an existing segment no running writer owns: closed, its writer's
+// process gone, or not shared frames at all
+bool staleSegment(const std::string & name){
+  int fd = shm_open(name.c_str(),O_RDONLY,0);
+  if (fd < 0){return errno == ENOENT;}
+  struct stat s;
+  if (fstat(fd,&s) != 0 || uint64_t(s.st_size) < sizeof(SharedFramesHeader)){
+    ::close(fd);
+    return true;
+  }
+  void * map = mmap(nullptr,sizeof(SharedFramesHeader),PROT_READ,MAP_SHARED,fd,0);
+  ::close(fd);
+  if (map == MAP_FAILED){return false;}
+  const SharedFramesHeader * h = static_cast<const SharedFramesHeader*>(map);
+  bool stale = std::memcmp(h->magic,SHARED_FRAMES_MAGIC,sizeof(h->magic)) != 0 ||
+    h->version != SHARED_FRAMES_VERSION ||
+    h->closed.load(std::memory_order_acquire) != 0 ||
+    h->writer == 0 || (kill(pid_t(h->writer),0) != 0 && errno == ESRCH);
+  munmap(map,sizeof(SharedFramesHeader));
+  return stale;
+}
+
+SharedFrames::~SharedFrames(){
+  if (header == nullptr){return;}
+  header->closed.store(1,std::memory_order_release);
+  munmap(data,length);
+  shm_unlink(name.c_str());
+}
+
+void SharedFrames::write(const float * state, uint64_t n, uint64_t step, double time){
+  if (header == nullptr){return;}
+  TraceScope trace("shared/write");
+  uint64_t frame = header->published.load(std::memory_order_relaxed);
+  uint8_t * slotData = data+header->headerBytes+(frame % header->nSlots)*header->slotBytes;
+  SharedSlotHeader * slot = reinterpret_cast<SharedSlotHeader*>(slotData);
+  n = std::min(n,header->nParticles);
+
+  uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence+1,std::memory_order_relaxed);
+  // readers seeing any of the new floats see the odd sequence
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->frame = frame;
+  slot->step = step;
+  slot->time = time;
+  slot->nParticles = n;
+  std::memcpy(slotData+header->dataOffset,state,n*3*sizeof(float));
+  slot->sequence.store(sequence+2,std::memory_order_release);
+  header->published.store(frame+1,std::memory_order_release);
+}
+
+SharedFramesReader::SharedFramesReader(std::string name)
+: data(nullptr), length(0), header(nullptr)
+{
+  name = sharedMemoryName(name);
+  int fd = shm_open(name.c_str(),O_RDONLY,0);
+  if (fd < 0){
+    std::cout << "Could not open shared memory " << name << "\n";
+    return;
+  }
+  struct stat s;
+  if (fstat(fd,&s) != 0 || uint64_t(s.st_size) < sizeof(SharedFramesHeader)){
+    std::cout << "Not shared frames (too small): " << name << "\n";
+    ::close(fd);
+    return;
+  }
+  void * map = mmap(nullptr,s.st_size,PROT_READ,MAP_SHARED,fd,0);
+  ::close(fd);
+  if (map == MAP_FAILED){
+    std::cout << "Could not map shared memory " << name << "\n";
+    return;
+  }
+  data = static_cast<const uint8_t*>(map);
+  length = s.st_size;
+
+  const SharedFramesHeader * h = reinterpret_cast<const SharedFramesHeader*>(data);
+  if (std::memcmp(h->magic,SHARED_FRAMES_MAGIC,sizeof(h->magic)) != 0 || h->version != SHARED_FRAMES_VERSION ||
+    h->headerBytes+uint64_t(h->nSlots)*h->slotBytes > length){
+    std::cout << "Not shared frames (bad header or version): " << name << "\n";
+    munmap(const_cast<uint8_t*>(data),length);
+    data = nullptr;
+    return;
+  }
+  header = h;
+}
+
+SharedFramesReader::~SharedFramesReader(){
+  if (data != nullptr){munmap(const_cast<uint8_t*>(data),length);}
+}
+
+const SharedSlotHeader * SharedFramesReader::latest(const float *& state, uint64_t & sequence){
+  if (header == nullptr){return nullptr;}
+  uint64_t frames = published();
+  if (frames == 0){return nullptr;}
+  const uint8_t * slotData = data+header->headerBytes+((frames-1) % header->nSlots)*header->slotBytes;
+  const SharedSlotHeader * slot = reinterpret_cast<const SharedSlotHeader*>(slotData);
+  sequence = slot->sequence.load(std::memory_order_acquire);
+  if (sequence & 1){return nullptr;}
+  state = reinterpret_cast<const float*>(slotData+header->dataOffset);
+  return slot;
+}
+
+bool SharedFramesReader::unchanged(const SharedSlotHeader * slot, uint64_t sequence){
+  // everything read before stays before the second sequence load
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
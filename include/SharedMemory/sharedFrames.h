@@ -0,0 +1,157 @@
+#ifndef SHAREDFRAMES_H
+#define SHAREDFRAMES_H
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+
+#include <trace.h>
+
+/*
+  Live frames in POSIX shared memory (shm_open), for analysis and
+  visualisation processes on the same host
+
+  [SharedFramesHeader][slot 0][slot 1]...[slot nSlots-1]
+
+  slot s starts at headerBytes+s*slotBytes (page aligned) and is a
+  SharedSlotHeader then, at dataOffset into the slot, nParticles*stride
+  floats laid out exactly as ParticleSystem::state (x,y,theta), as in
+  a trajectory frame.
+
+  Frame k (counting from 0) goes in slot k % nSlots and published is
+  k+1 once it is complete. Each slot is a seqlock, its sequence is odd
+  while the slot is being written and even otherwise. A reader maps
+  the segment read only and, without copying,
+
+    1. takes published (0 is nothing yet), slot (published-1) % nSlots
+    2. reads the slot's sequence, odd means pick again
+    3. uses the floats in place
+    4. reads sequence again, if it changed the frame was overwritten
+       under it and what was computed is discarded
+
+  The writer never waits, with nSlots frames in the ring a reader has
+  nSlots-1 frames of time before its slot is reused. Counters are
+  64 bit lock free atomics, plain aligned 64 bit loads with acquire
+  ordering from C or numpy. SharedFramesReader does the above.
+*/
+
+const char SHARED_FRAMES_MAGIC[8] = {'J','E','R','B','O','A','S','H'};
+const uint32_t SHARED_FRAMES_VERSION = 1;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared frames need lock free 64 bit atomics");
+
+struct SharedFramesHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t stride;                                                                // floats per particle
+  uint64_t nParticles;
+  uint32_t nSlots;
+  uint32_t headerBytes;                                                           // offset of slot 0
+  uint64_t slotBytes;                                                             // slot to slot
+  uint64_t dataOffset;                                                            // floats from the start of a slot
+  float dt;
+  float density;
+  float radius;
+  uint32_t stepsPerFrame;                                                         // simulation steps between frames
+  std::atomic<uint64_t> published;                                                // frames completed
+  std::atomic<uint64_t> closed;                                                   // 1 once the writer has gone
+  uint64_t writer;                                                                // pid of the writing process
+  uint8_t padding[40];
+};
+
+struct SharedSlotHeader {
+  std::atomic<uint64_t> sequence;                                                 // odd while written
+  uint64_t frame;
+  uint64_t step;                                                                  // ParticleSystem::getSteps()
+  double time;                                                                    // wallClock() when written
+  uint64_t nParticles;                                                            // valid in this slot, <= header's
+  uint8_t padding[24];
+};
+
+static_assert(sizeof(SharedFramesHeader) == 128, "SharedFramesHeader must be 128 bytes");
+static_assert(sizeof(SharedSlotHeader) == 64, "SharedSlotHeader must be 64 bytes");
+
+/*
+  The writing side, made by ParticleSystem::shareFrames(). The segment
+  is created and sized once, removed by the destructor, readers still
+  mapping it keep their view. An existing segment of the same name is
+  only replaced when it is stale (closed, its writer gone, or not ours
+  at all); one a live run is writing makes this fail as in use.
+*/
+class SharedFrames {
+public:
+
+  SharedFrames(
+    std::string name,
+    uint64_t nParticles,
+    uint32_t nSlots,
+    float dt,
+    float density,
+    float radius,
+    uint32_t stepsPerFrame
+  );
+
+  ~SharedFrames();
+
+  SharedFrames(const SharedFrames &) = delete;
+  SharedFrames & operator=(const SharedFrames &) = delete;
+
+  bool isOpen(){return header != nullptr;}
+  uint64_t bytes(){return length;}
+  std::string getName(){return name;}
+
+  // copy n particles' x,y,theta into the next slot and publish it
+  void write(const float * state, uint64_t n, uint64_t step, double time);
+
+private:
+  std::string name;
+  uint8_t * data;
+  uint64_t length;
+  SharedFramesHeader * header;
+};
+
+/*
+  Read only view of a segment written by SharedFrames, zero copy.
+
+    const float * x;
+    uint64_t sequence;
+    const SharedSlotHeader * slot = reader.latest(x,sequence);
+    if (slot != nullptr){
+      ... use x[0 .. slot->nParticles*stride) ...
+      if (!reader.unchanged(slot,sequence)){ ... discard ... }
+    }
+*/
+class SharedFramesReader {
+public:
+
+  SharedFramesReader(std::string name);
+  ~SharedFramesReader();
+
+  SharedFramesReader(const SharedFramesReader &) = delete;
+  SharedFramesReader & operator=(const SharedFramesReader &) = delete;
+
+  bool isOpen(){return header != nullptr;}
+  const SharedFramesHeader & getHeader(){return *header;}
+  uint64_t published(){return header->published.load(std::memory_order_acquire);}
+  bool writerClosed(){return header->closed.load(std::memory_order_acquire) != 0;}
+
+  // the newest complete frame, nullptr if none or it is being rewritten
+  const SharedSlotHeader * latest(const float *& state, uint64_t & sequence);
+  // still the frame latest() gave, i.e everything read since is valid
+  bool unchanged(const SharedSlotHeader * slot, uint64_t sequence);
+
+private:
+  const uint8_t * data;
+  uint64_t length;
+  const SharedFramesHeader * header;
+};
+
+// a segment of this name exists but no running writer owns it
+bool staleSegment(const std::string & name);
+
+// shm_open names are one path component with a leading /
+inline std::string sharedMemoryName(std::string name){
+  return name.size() > 0 && name[0] == '/' ? name : "/"+name;
+}
+
+#endif
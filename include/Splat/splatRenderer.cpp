@@ -0,0 +1,130 @@
+#include <Splat/splatRenderer.h>
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+float cmapPoly(float x, float a, float b, float c, float d){
+  float v = x*a+x*x*b+x*x*x*c+d;
+  return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+void cmap(float t, float & r, float & g, float & b){
+  r = cmapPoly(t,1.2,-8.7,7.6,0.9);
+  g = cmapPoly(t,5.6,-13.4,7.9,0.2);
+  b = cmapPoly(t,-7.9,16.0,-8.4,1.2);
+}
+
+SplatRenderer::SplatRenderer(uint32_t width, uint32_t height, unsigned threads, uint32_t tileSize)
+: width(width), height(height), threads(threads == 0 ? defaultThreads() : threads), tileSize(tileSize)
+{
+  tilesX = (width+tileSize-1)/tileSize;
+  tilesY = (height+tileSize-1)/tileSize;
+  scale = float(std::min(width,height));
+  offsetX = 0.5f*(width-scale);
+  offsetY = 0.5f*(height-scale);
+  rgb.resize(uint64_t(width)*height*3);
+}
+
+void SplatRenderer::bin(const float * state, uint64_t n, float r){
+  uint64_t tiles = uint64_t(tilesX)*tilesY;
+  tileStart.assign(tiles+1,0);
+
+  // a disc is listed in each tile its bounding box touches, nearly always one
+  auto range = [&](uint64_t i, int64_t & x0, int64_t & x1, int64_t & y0, int64_t & y1){
+    float px = offsetX+state[i*3]*scale;
+    float py = offsetY+(1.0f-state[i*3+1])*scale;
+    x0 = std::max(int64_t(0),int64_t(std::floor((px-r-1.0f)/tileSize)));
+    x1 = std::min(int64_t(tilesX)-1,int64_t(std::floor((px+r+1.0f)/tileSize)));
+    y0 = std::max(int64_t(0),int64_t(std::floor((py-r-1.0f)/tileSize)));
+    y1 = std::min(int64_t(tilesY)-1,int64_t(std::floor((py+r+1.0f)/tileSize)));
+  };
+
+  int64_t x0, x1, y0, y1;
+  for (uint64_t i = 0; i < n; i++){
+    range(i,x0,x1,y0,y1);
+    for (int64_t ty = y0; ty <= y1; ty++){
+      for (int64_t tx = x0; tx <= x1; tx++){
+        tileStart[ty*tilesX+tx+1]++;
+      }
+    }
+  }
+  for (uint64_t t = 0; t < tiles; t++){
+    tileStart[t+1] += tileStart[t];
+  }
+
+  index.resize(tileStart[tiles]);
+  tileFill.assign(tileStart.begin(),tileStart.end()-1);
+  for (uint64_t i = 0; i < n; i++){
+    range(i,x0,x1,y0,y1);
+    for (int64_t ty = y0; ty <= y1; ty++){
+      for (int64_t tx = x0; tx <= x1; tx++){
+        index[tileFill[ty*tilesX+tx]++] = uint32_t(i);
+      }
+    }
+  }
+}
+
+void SplatRenderer::splatTile(uint64_t tile, const float * state, float r){
+  int64_t tx0 = int64_t(tile % tilesX)*tileSize;
+  int64_t ty0 = int64_t(tile / tilesX)*tileSize;
+  int64_t tx1 = std::min(int64_t(width),tx0+tileSize);
+  int64_t ty1 = std::min(int64_t(height),ty0+tileSize);
+
+  // discs under a pixel across fade with their area rather than vanish
+  float weight = std::min(1.0f,2.0f*r);
+  const float inv2Pi = 1.0/(2.0*M_PI);
+
+  for (uint64_t k = tileStart[tile]; k < tileStart[tile+1]; k++){
+    uint64_t i = index[k];
+    float px = offsetX+state[i*3]*scale;
+    float py = offsetY+(1.0f-state[i*3+1])*scale;
+    float t = state[i*3+2]*inv2Pi;
+    float cr, cg, cb;
+    cmap(t-std::floor(t),cr,cg,cb);
+
+    int64_t x0 = std::max(tx0,int64_t(std::floor(px-r-0.5f)));
+    int64_t x1 = std::min(tx1-1,int64_t(std::floor(px+r+0.5f)));
+    int64_t y0 = std::max(ty0,int64_t(std::floor(py-r-0.5f)));
+    int64_t y1 = std::min(ty1-1,int64_t(std::floor(py+r+0.5f)));
+
+    for (int64_t y = y0; y <= y1; y++){
+      float dy = y+0.5f-py;
+      uint8_t * row = rgb.data()+(y*uint64_t(width))*3;
+      for (int64_t x = x0; x <= x1; x++){
+        float dx = x+0.5f-px;
+        // one pixel wide linear edge, like the shader's smoothstep
+        float a = r+0.5f-std::sqrt(dx*dx+dy*dy);
+        if (a <= 0.0f){continue;}
+        a = std::min(a,1.0f)*weight;
+        uint8_t * p = row+x*3;
+        p[0] = uint8_t(p[0]+(cr*255.0f-p[0])*a+0.5f);
+        p[1] = uint8_t(p[1]+(cg*255.0f-p[1])*a+0.5f);
+        p[2] = uint8_t(p[2]+(cb*255.0f-p[2])*a+0.5f);
+      }
+    }
+  }
+}
+
+void SplatRenderer::render(const float * state, uint64_t n, float radius){
+  TraceScope trace("splat");
+  float r = radius*scale;
+  bin(state,n,r);
+
+  parallelFor(
+    0,
+    tilesY,
+    [&](uint64_t first, uint64_t last, unsigned thread){
+      // clear our own rows while they are hot, then splat
+      uint64_t y0 = first*tileSize;
+      uint64_t y1 = std::min(uint64_t(height),last*tileSize);
+      std::memset(rgb.data()+y0*width*3,255,(y1-y0)*width*3);
+      for (uint64_t ty = first; ty < last; ty++){
+        for (uint64_t tx = 0; tx < tilesX; tx++){
+          splatTile(ty*tilesX+tx,state,r);
+        }
+      }
+    },
+    threads
+  );
+}
@@ -0,0 +1,68 @@
+#ifndef SPLATRENDERER_H
+#define SPLATRENDERER_H
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+#include <parallel.h>
+#include <Capture/pngUtils.h>
+#include <trace.h>
+
+// the PHASE4 cubic colour map of particleVertexShader, t in [0,1]
+void cmap(float t, float & r, float & g, float & b);
+
+/*
+  Renders particles to an RGB image on the CPU, no GL needed, for
+  snapshots on machines without a GPU.
+
+  The unit box is fitted to the image, centred, and particles drawn as
+  anti-aliased discs coloured by orientation over white, as on screen.
+  The image is cut into square tiles, each a block of a grid over the
+  box, and particles are binned into every tile their disc touches.
+  Tiles then splat their own particles independently, so rows of
+  tiles run in parallel with no shared writes.
+*/
+class SplatRenderer {
+public:
+
+  SplatRenderer(uint32_t width, uint32_t height, unsigned threads = 0, uint32_t tileSize = 64);
+
+  // n x,y,theta triples of the given radius (in box units)
+  void render(const float * state, uint64_t n, float radius);
+
+  bool write(std::string path){
+    TraceScope trace("io/snapshot");
+    return writePNG(path,rgb.data(),width,height,false);
+  }
+
+  const std::vector<uint8_t> & image(){return rgb;}
+  uint32_t getWidth(){return width;}
+  uint32_t getHeight(){return height;}
+
+private:
+
+  void bin(const float * state, uint64_t n, float r);
+  void splatTile(uint64_t tile, const float * state, float r);
+
+  uint32_t width;
+  uint32_t height;
+  unsigned threads;
+  uint32_t tileSize;
+  uint32_t tilesX;
+  uint32_t tilesY;
+
+  // box to pixels, y flipped so the top row is y = 1
+  float scale;
+  float offsetX;
+  float offsetY;
+
+  std::vector<uint8_t> rgb;
+
+  // particles per tile, tile t is index[tileStart[t],tileStart[t+1])
+  std::vector<uint64_t> tileStart;
+  std::vector<uint64_t> tileFill;
+  std::vector<uint32_t> index;
+};
+
+#endif
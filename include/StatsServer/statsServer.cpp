@@ -0,0 +1,200 @@
+#include <StatsServer/statsServer.h>
+
+#include <sstream>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+
+// how often the step rate is resampled, and the longest a client may take to ask
+const int statsSampleMillis = 1000;
+const int statsRequestMillis = 1000;
+
+StatsServer::StatsServer(std::string path, ParticleSystem & particles)
+: path(path), particles(particles), listening(-1), running(false),
+  sampledSteps(0), sampledTime(wallClock()), stepRate(0.0)
+{
+  sockaddr_un address;
+  std::memset(&address,0,sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)){
+    std::cout << "Stats socket path too long " << path << "\n";
+    return;
+  }
+  std::strncpy(address.sun_path,path.c_str(),sizeof(address.sun_path)-1);
+
+  // a socket left by a previous run is replaced, anything else is not ours to remove
+  struct stat info;
+  if (lstat(path.c_str(),&info) == 0){
+    if (!S_ISSOCK(info.st_mode)){
+      std::cout << path << " exists and is not a socket, not serving stats\n";
+      return;
+    }
+    unlink(path.c_str());
+  }
+
+  listening = socket(AF_UNIX,SOCK_STREAM,0);
+  if (listening < 0){
+    std::cout << "Could not create stats socket: " << std::strerror(errno) << "\n";
+    return;
+  }
+  if (bind(listening,(sockaddr*)&address,sizeof(address)) != 0 || listen(listening,8) != 0){
+    std::cout << "Could not listen on " << path << ": " << std::strerror(errno) << "\n";
+    close(listening);
+    listening = -1;
+    return;
+  }
+
+  running = true;
+  worker = std::thread(&StatsServer::loop,this);
+  std::cout << "Serving stats on " << path << "\n";
+}
+
+void StatsServer::stop(){
+  if (!running){return;}
+  running = false;
+  worker.join();
+  close(listening);
+  listening = -1;
+  unlink(path.c_str());
+}
+
+void StatsServer::sampleStepRate(){
+  double now = wallClock();
+  if (now-sampledTime < statsSampleMillis/1000.0){return;}
+  uint64_t steps = particles.getStats().steps;
+  stepRate = (steps-sampledSteps)/(now-sampledTime);
+  sampledSteps = steps;
+  sampledTime = now;
+}
+
+void StatsServer::loop(){
+  tracer().nameThread("stats");
+  pollfd p;
+  p.fd = listening;
+  p.events = POLLIN;
+  while (running){
+    // wake regularly to sample the step rate and notice stop()
+    int ready = poll(&p,1,statsSampleMillis/4);
+    sampleStepRate();
+    if (ready <= 0 || !(p.revents & POLLIN)){continue;}
+    int client = accept(listening,nullptr,nullptr);
+    if (client < 0){continue;}
+    serve(client);
+    close(client);
+  }
+}
+
+void StatsServer::serve(int client){
+  TraceScope trace("stats/request");
+  // one line, or an HTTP request line, whichever comes first
+  std::string request;
+  char buffer[1024];
+  pollfd p;
+  p.fd = client;
+  p.events = POLLIN;
+  while (request.find('\n') == std::string::npos && request.size() < 4096){
+    if (poll(&p,1,statsRequestMillis) <= 0){break;}
+    ssize_t n = recv(client,buffer,sizeof(buffer),0);
+    if (n <= 0){break;}
+    request.append(buffer,n);
+  }
+  request = request.substr(0,request.find_first_of("\r\n"));
+
+  bool http = request.compare(0,4,"GET ") == 0;
+  std::string target = http ? request.substr(4,request.find(' ',4)-4) : request;
+  std::string body, type;
+  if (target == "json" || target == "/json" || target == "/stats"){
+    body = json();
+    type = "application/json";
+  }
+  else if (target == "metrics" || target == "/metrics"){
+    body = prometheus();
+    type = "text/plain; version=0.0.4";
+  }
+
+  std::string response;
+  if (http){
+    response = body == "" ? "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n" :
+      "HTTP/1.0 200 OK\r\nContent-Type: "+type+"\r\nContent-Length: "+std::to_string(body.size())+"\r\n\r\n"+body;
+  }
+  else{
+    response = body == "" ? "unknown request, ask for json or metrics\n" : body;
+  }
+
+  uint64_t sent = 0;
+  while (sent < response.size()){
+    ssize_t n = send(client,response.data()+sent,response.size()-sent,MSG_NOSIGNAL);   // a client gone is not a signal
+    if (n <= 0){return;}
+    sent += n;
+  }
+}
+
+std::string StatsServer::json(){
+  SimulationStats stats = particles.getStats();
+  std::stringstream out;
+  out << "{\"steps_per_second\":" << stepRate << ",\"particles\":" << stats.particles << ",\"stats\":";
+  writeStatsJSON(out,stats);
+  out << ",\"memory\":";
+  writeMemoryJSON(out,particles.memory());
+  out << ",\"telemetry\":{";
+  for (uint8_t m = 0; m < uint8_t(Metric::COUNT); m++){
+    MetricSummary s = telemetry().summary(Metric(m));
+    out << (m == 0 ? "" : ",") << "\"" << metricName(Metric(m)) << "\":{\"n\":" << s.n << ",\"mean\":" << s.mean
+      << ",\"p50\":" << s.p50 << ",\"p95\":" << s.p95 << ",\"p99\":" << s.p99 << ",\"max\":" << s.max << "}";
+  }
+  out << "}}\n";
+  return out.str();
+}
+
+std::string StatsServer::prometheus(){
+  SimulationStats stats = particles.getStats();
+  MemoryReport memory = particles.memory();
+  std::stringstream out;
+  out.precision(15);                                                              // counters keep every digit as they grow
+
+  out << "# TYPE jerboa_steps_total counter\njerboa_steps_total " << stats.steps << "\n";
+  out << "# TYPE jerboa_steps_per_second gauge\njerboa_steps_per_second " << stepRate << "\n";
+  out << "# TYPE jerboa_particles gauge\njerboa_particles " << stats.particles << "\n";
+
+  out << "# TYPE jerboa_phase_seconds_total counter\n";
+  for (uint8_t p = 0; p < STEP_PHASES; p++){
+    out << "jerboa_phase_seconds_total{phase=\"" << stepPhaseName(StepPhase(p)) << "\"} " << stats.phases[p].seconds << "\n";
+  }
+  if (stats.counters()){
+    out << "# TYPE jerboa_phase_events_total counter\n";
+    for (uint8_t p = 0; p < STEP_PHASES; p++){
+      for (uint8_t c = 0; c < PERF_COUNTERS; c++){
+        if (!stats.haveCounter[c]){continue;}
+        out << "jerboa_phase_events_total{phase=\"" << stepPhaseName(StepPhase(p)) << "\",event=\""
+          << perfCounterName(PerfCounter(c)) << "\"} " << stats.phases[p].counters.counts[c] << "\n";
+      }
+    }
+  }
+
+  out << "# TYPE jerboa_pair_tests gauge\njerboa_pair_tests " << stats.load.pairTests << "\n";
+  out << "# TYPE jerboa_max_cell_occupancy gauge\njerboa_max_cell_occupancy " << stats.load.maxOccupancy << "\n";
+
+  out << "# TYPE jerboa_memory_bytes gauge\n";
+  out << "jerboa_memory_bytes{kind=\"host\"} " << memory.total(false) << "\n";
+  out << "jerboa_memory_bytes{kind=\"gpu\"} " << memory.total(true) << "\n";
+  out << "jerboa_memory_bytes{kind=\"rss\"} " << memory.rss << "\n";
+  out << "jerboa_memory_bytes{kind=\"peak_rss\"} " << memory.peakRss << "\n";
+
+  // percentiles over the telemetry window, sum and count over the whole run
+  for (uint8_t m = 0; m < uint8_t(Metric::COUNT); m++){
+    MetricSummary s = telemetry().summary(Metric(m));
+    std::string name = std::string("jerboa_")+metricName(Metric(m))+"_seconds";
+    out << "# TYPE " << name << " summary\n";
+    out << name << "{quantile=\"0.5\"} " << s.p50 << "\n";
+    out << name << "{quantile=\"0.95\"} " << s.p95 << "\n";
+    out << name << "{quantile=\"0.99\"} " << s.p99 << "\n";
+    out << name << "{quantile=\"1\"} " << s.max << "\n";
+    out << name << "_sum " << telemetry().total(Metric(m)) << "\n";
+    out << name << "_count " << telemetry().count(Metric(m)) << "\n";
+  }
+  return out.str();
+}
@@ -0,0 +1,61 @@
+#ifndef STATSSERVER_H
+#define STATSSERVER_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <atomic>
+
+#include <ParticleSystem/particleSystem.h>
+#include <telemetry.h>
+
+/*
+  Serves live statistics on a Unix domain socket from a background
+  thread: step rate, per phase step times, particle count, memory use
+  and the telemetry percentiles.
+
+  A client sends one request line and gets one response, then the
+  connection is closed
+
+    json            -> JSON
+    metrics         -> Prometheus text exposition
+    GET /json ...   -> the same over HTTP/1.0, and GET /metrics, e.g
+                       curl --unix-socket jerboa.sock http://localhost/metrics
+
+  Everything is read from snapshots, ParticleSystem::getStats(),
+  ParticleSystem::memory() and the telemetry rings, so the step loop
+  is never held up by a request.
+*/
+class StatsServer {
+public:
+
+  StatsServer(std::string path, ParticleSystem & particles);
+
+  ~StatsServer(){stop();}
+
+  bool isOpen(){return listening >= 0;}
+
+  void stop();
+
+  std::string json();
+  std::string prometheus();
+
+private:
+
+  void loop();
+  void serve(int client);
+  void sampleStepRate();
+
+  std::string path;
+  ParticleSystem & particles;
+  int listening;
+  std::atomic<bool> running;
+  std::thread worker;
+
+  // steps per second over the last sampling interval
+  uint64_t sampledSteps;
+  double sampledTime;
+  double stepRate;
+};
+
+#endif
@@ -1,14 +1,17 @@
 #ifndef GLYPH_H
 #define GLYPH_H
 
+// a character's metrics and where its bitmap sits in the Type's atlas
 struct Glyph {
-  Glyph(){}
-  Glyph(GLuint & u, glm::ivec2 s, glm::ivec2 b, uint64_t o)
-  : textureID(u), size(s), bearing(b), offset(o) {}
-  GLuint textureID;
+  Glyph()
+  : size(0,0), bearing(0,0), offset(0), uvMin(0.0,0.0), uvMax(0.0,0.0) {}
+  Glyph(glm::ivec2 s, glm::ivec2 b, uint64_t o, glm::vec2 u0, glm::vec2 u1)
+  : size(s), bearing(b), offset(o), uvMin(u0), uvMax(u1) {}
   glm::ivec2 size;
   glm::ivec2 bearing;
   uint64_t offset;
+  glm::vec2 uvMin;                                                                // atlas texture coordinates, top left
+  glm::vec2 uvMax;                                                                // bottom right
 };
 
 #endif
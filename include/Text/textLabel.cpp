@@ -0,0 +1,128 @@
+#include <Text/textLabel.h>
+
+void layoutText(
+  Type & type,
+  const std::string & text,
+  float x,
+  float y,
+  float scale,
+  std::vector<float> & out
+){
+    // have a look at this https://learnopengl.com/In-Practice/Text-Rendering
+    // Some modifications have been made, e.g to render \n characters as line breaks
+
+    float initalX = x;
+
+    std::string::const_iterator c;
+    for (c = text.begin(); c != text.end(); c++){
+        // quick and dirty line break
+        if (*c == '\n'){
+          y -= TEXT_LINE_HEIGHT;
+          x = initalX;
+          continue;
+        }
+
+        Glyph & ch = type[*c];
+
+        float xpos = x + ch.bearing.x * scale;
+        float ypos = y - (ch.size.y - ch.bearing.y) * scale;
+
+        float w = ch.size.x * scale;
+        float h = ch.size.y * scale;
+        float u0 = ch.uvMin.x, v0 = ch.uvMin.y;
+        float u1 = ch.uvMax.x, v1 = ch.uvMax.y;
+
+        float quad[6][4] = {
+            { xpos,     ypos + h,   u0, v0 },
+            { xpos,     ypos,       u0, v1 },
+            { xpos + w, ypos,       u1, v1 },
+
+            { xpos,     ypos + h,   u0, v0 },
+            { xpos + w, ypos,       u1, v1 },
+            { xpos + w, ypos + h,   u1, v0 }
+        };
+        out.insert(out.end(),&quad[0][0],&quad[0][0]+6*4);
+        // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
+        x += (ch.offset >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
+    }
+}
+
+TextLabel::TextLabel(Type & type, float x, float y, float scale)
+: type(type), x(x), y(y), scale(scale), capacity(0), count(0)
+{
+  glGenVertexArrays(1,&VAO);
+  glGenBuffers(1,&VBO);
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0,4,GL_FLOAT,GL_FALSE,4*sizeof(float),0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+  glError("TextLabel constructor: ");
+}
+
+void TextLabel::setText(const std::string & t){
+  if (t == text){return;}
+  text = t;
+
+  // only lines that differ from last time are laid out again
+  uint64_t n = 0;
+  uint64_t start = 0;
+  bool changed = false;
+  while (start <= text.size()){
+    uint64_t end = text.find('\n',start);
+    if (end == std::string::npos){end = text.size();}
+    bool added = n >= lines.size();
+    if (added){
+      lines.push_back("");
+      lineVertices.push_back(std::vector<float>());
+    }
+    if (added || text.compare(start,end-start,lines[n]) != 0){
+      lines[n].assign(text,start,end-start);
+      lineVertices[n].clear();
+      layoutText(type,lines[n],x,y-n*TEXT_LINE_HEIGHT,scale,lineVertices[n]);
+      changed = true;
+    }
+    n++;
+    start = end+1;
+  }
+  if (n != lines.size()){
+    lines.resize(n);
+    lineVertices.resize(n);
+    changed = true;
+  }
+
+  if (changed){upload();}
+}
+
+void TextLabel::setPosition(float px, float py){
+  if (px == x && py == y){return;}
+  x = px;
+  y = py;
+  // everything moves, lay it all out again
+  std::string t = text;
+  text.clear();
+  lines.clear();
+  lineVertices.clear();
+  setText(t);
+}
+
+void TextLabel::upload(){
+  vertices.clear();
+  for (uint64_t l = 0; l < lineVertices.size(); l++){
+    vertices.insert(vertices.end(),lineVertices[l].begin(),lineVertices[l].end());
+  }
+  count = vertices.size()/4;
+  if (vertices.empty()){return;}
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  if (vertices.size() > capacity){
+    capacity = vertices.size();
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float)*capacity, vertices.data(), GL_DYNAMIC_DRAW);
+  }
+  else{
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float)*vertices.size(), vertices.data());
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glError("TextLabel upload: ");
+}
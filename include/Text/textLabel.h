@@ -0,0 +1,70 @@
+#ifndef TEXTLABEL_H
+#define TEXTLABEL_H
+
+#include <Text/type.cpp>
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+
+// line spacing in pixels, not scaled
+const float TEXT_LINE_HEIGHT = 32.0f;
+
+// append the x,y,u,v triangles for text starting at x,y
+void layoutText(
+  Type & type,
+  const std::string & text,
+  float x,
+  float y,
+  float scale,
+  std::vector<float> & out
+);
+
+/*
+  Text whose glyph quads are kept on the GPU between frames. Layout
+  and upload only happen when setText is given something different,
+  and then only for the lines that changed, so drawing a static or
+  slowly changing label is a bind and a draw call.
+
+  Drawn with TextRenderer::renderText(label,colour).
+*/
+class TextLabel {
+public:
+
+  TextLabel(Type & type, float x, float y, float scale);
+
+  ~TextLabel(){
+    glDeleteBuffers(1,&VBO);
+    glDeleteVertexArrays(1,&VAO);
+  }
+
+  TextLabel(const TextLabel &) = delete;
+  TextLabel & operator=(const TextLabel &) = delete;
+
+  void setText(const std::string & text);
+  void setPosition(float x, float y);
+
+  const std::string & getText(){return text;}
+
+private:
+
+  friend class TextRenderer;
+
+  void upload();
+
+  Type & type;
+  float x;
+  float y;
+  float scale;
+
+  std::string text;
+  std::vector<std::string> lines;
+  std::vector<std::vector<float>> lineVertices;                                   // laid out per line
+  std::vector<float> vertices;                                                    // all lines, as uploaded
+
+  GLuint VAO;
+  GLuint VBO;
+  uint64_t capacity;                                                              // floats the VBO can hold
+  uint64_t count;                                                                 // vertices to draw
+};
+
+#endif
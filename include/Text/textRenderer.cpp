@@ -1,7 +1,9 @@
 #include <Text/textRenderer.h>
 #include <glUtils.h>
 
-TextRenderer::TextRenderer(glm::mat4 p){
+TextRenderer::TextRenderer(glm::mat4 p)
+: capacity(6*4)
+{
   projection = p;
   // text buffers
   glGenVertexArrays(1,&VAO);
@@ -15,79 +17,64 @@ TextRenderer::TextRenderer(glm::mat4 p){
   glBindVertexArray(0);
   glError("TextRenderer constructor: ");
 
-  shader = glCreateProgram();
-  compileShader(shader,defaultVertexShader,defaultFragmentShader);
+  shader = shaderManager().program(defaultVertexShader,defaultFragmentShader);
   glUseProgram(shader);
 
   glUniformMatrix4fv(
-    glGetUniformLocation(shader,"proj"),
+    shaderManager().location(shader,"proj"),
     1,
     GL_FALSE,
     &projection[0][0]
   );
+  // the atlas is always on unit 0
+  glUniform1i(shaderManager().location(shader, "glyph"), 0);
+  textColour = shaderManager().location(shader, "textColour");
 }
 
 void TextRenderer::renderText(
-  Type type,
-  std::string text,
+  Type & type,
+  const std::string & text,
   float x,
   float y,
   float scale,
   glm::vec3 colour){
-    // have a look at this https://learnopengl.com/In-Practice/Text-Rendering
-    // Some modifications have been made, e.g to render \n characters as line breaks
+    TraceScope trace("text");
+    vertices.clear();
+    layoutText(type,text,x,y,scale,vertices);
+
+    if (vertices.empty()){return;}
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
     glUseProgram(shader);
-    glUniform3f(glGetUniformLocation(shader, "textColour"), colour.x, colour.y, colour.z);
-    glError("Setting textColour uniform for type: ");
-    glUniform1i(glGetUniformLocation(shader, "glyph"), 0);
-    glError("Setting texture id uniform for type: ");
+    setColour(colour);
     glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, type.texture());
     glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    if (vertices.size() > capacity){
+      capacity = vertices.size();
+      glBufferData(GL_ARRAY_BUFFER, sizeof(float)*capacity, vertices.data(), GL_DYNAMIC_DRAW);
+    }
+    else{
+      glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float)*vertices.size(), vertices.data());
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDrawArrays(GL_TRIANGLES, 0, vertices.size()/4);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glError("Rendering text: ");
+}
 
-    float initalX = x;
-
-    // iterate through all characters
-    std::string::const_iterator c;
-    for (c = text.begin(); c != text.end(); c++){
-        Glyph ch = type[*c];
-
-        // quick and dirty line break
-        if (*c == '\n'){
-          y -= 32.0f;
-          x = initalX;
-          continue;
-        }
-
-        float xpos = x + ch.bearing.x * scale;
-        float ypos = y - (ch.size.y - ch.bearing.y) * scale;
-
-        float w = ch.size.x * scale;
-        float h = ch.size.y * scale;
-        // update VBO for each character
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
+void TextRenderer::renderText(TextLabel & label, glm::vec3 colour){
+    if (label.count == 0){return;}
+    TraceScope trace("text");
 
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }
-        };
-        // render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.textureID);
-        // update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-        glError("Setting data for Glyph texture " + std::to_string(*c) + " :");
-        glBufferStatus("Setting data for Glyph texture "+ std::to_string(*c) + " :");
-        // render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-        x += (ch.offset >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
-    }
+    glUseProgram(shader);
+    setColour(colour);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, label.type.texture());
+    glBindVertexArray(label.VAO);
+    glDrawArrays(GL_TRIANGLES, 0, label.count);
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
+    glError("Rendering text label: ");
 }
@@ -1,9 +1,12 @@
 #ifndef TEXTRENDERER_H
 #define TEXTRENDERER_H
 
-#include <Text/type.cpp>
+#include <Text/textLabel.cpp>
+#include <shaderManager.h>
+#include <trace.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <vector>
 
 class TextRenderer {
 public:
@@ -15,18 +18,33 @@ public:
     glDeleteProgram(shader);
   }
 
+  // one vertex upload and one draw call for the whole string
   void renderText(
-    Type type,
-    std::string text,
+    Type & type,
+    const std::string & text,
     float x,
     float y,
     float scale,
     glm::vec3 colour);
 
+  // a retained label, nothing is laid out or uploaded here
+  void renderText(TextLabel & label, glm::vec3 colour);
+
 private:
+
+  void setColour(glm::vec3 colour){
+    if (colour == lastColour){return;}
+    glUniform3f(textColour, colour.x, colour.y, colour.z);
+    lastColour = colour;
+  }
+
   GLuint shader;
+  GLint textColour;
+  glm::vec3 lastColour = glm::vec3(-1.0f);
   GLuint VAO;
   GLuint VBO;
+  uint64_t capacity;                                                              // floats the VBO can hold
+  std::vector<float> vertices;                                                    // reused between calls
 
   glm::mat4 projection;
 
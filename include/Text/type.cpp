@@ -1,31 +1,55 @@
 #include <Text/type.h>
 #include <Text/typeUtils.h>
 
-Type::Type(std::string path, std::string font, uint8_t w){
+Type::Type(std::string path, std::string font, uint8_t w)
+: atlas(0)
+{
 
   width = w;
   name = font;
-  //construct freetype objects
-  FT_Library ftLib;
-  if (FT_Init_FreeType(&ftLib)){
-    std::cout << "Could not init FreeType\n";
-  }
-  FT_Face ftFace;
-  if (FT_New_Face(ftLib,(path+font).c_str(),0,&ftFace)){
-    std::cout << "Could not load font: " + font + " at: " + path + "\n";
-  }
 
-  FT_Set_Pixel_Sizes(ftFace,0,width); //dynamic width for height 48
+  std::vector<uint8_t> pixels;
+  uint32_t atlasWidth = 0, atlasHeight = 0;
+  std::string cache = path+font+"."+std::to_string(width)+".atlas";
 
-  glyphs.clear();
+  if (!readGlyphAtlas(cache,path+font,width,glyphs,pixels,atlasWidth,atlasHeight)){
+    //construct freetype objects
+    FT_Library ftLib;
+    if (FT_Init_FreeType(&ftLib)){
+      std::cout << "Could not init FreeType\n";
+    }
+    FT_Face ftFace;
+    if (FT_New_Face(ftLib,(path+font).c_str(),0,&ftFace)){
+      std::cout << "Could not load font: " + font + " at: " + path + "\n";
+    }
 
-  loadASCIIGlyphs(ftFace,glyphs);
+    FT_Set_Pixel_Sizes(ftFace,0,width); //dynamic width for height 48
 
-  FT_Done_Face(ftFace);
-  FT_Done_FreeType(ftLib);
+    loadASCIIGlyphs(ftFace,glyphs,pixels,atlasWidth,atlasHeight);
 
-}
+    FT_Done_Face(ftFace);
+    FT_Done_FreeType(ftLib);
+
+    writeGlyphAtlas(cache,path+font,width,glyphs,pixels,atlasWidth,atlasHeight);
+  }
 
-Glyph & Type::operator[](char c){
-  return glyphs[c];
+  glGenTextures(1,&atlas);
+  glBindTexture(GL_TEXTURE_2D,atlas);
+  glTexImage2D(
+    GL_TEXTURE_2D,
+    0,
+    GL_RED,
+    atlasWidth,
+    atlasHeight,
+    0,
+    GL_RED,
+    GL_UNSIGNED_BYTE,
+    pixels.data()
+  );
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D,0);
+  glError("Loading glyph atlas for "+font+" :");
 }
@@ -6,8 +6,16 @@
 
 #include <Text/glyph.h>
 
-typedef std::map<char,Glyph> GlyphMap;
+const uint8_t ASCII_GLYPHS = 128;
 
+/*
+  A font at one pixel size, every ASCII glyph packed into a single
+  GL_RED atlas texture so a whole string draws with one texture bound.
+
+  The rasterised atlas is cached next to the font as
+  <font>.<width>.atlas and reused while the font file is unchanged,
+  skipping FreeType entirely at startup.
+*/
 class Type {
 public:
   Type(
@@ -16,9 +24,17 @@ public:
     uint8_t w
   );
 
-  Glyph & operator[](char c);
+  ~Type(){glDeleteTextures(1,&atlas);}
+
+  // owns a texture, pass by reference
+  Type(const Type &) = delete;
+  Type & operator=(const Type &) = delete;
+
+  Glyph & operator[](char c){return glyphs[uint8_t(c) % ASCII_GLYPHS];}
+  GLuint texture(){return atlas;}
 private:
-  GlyphMap glyphs;
+  Glyph glyphs[ASCII_GLYPHS];
+  GLuint atlas;
   uint8_t width;
   std::string name;
 };
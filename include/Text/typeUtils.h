@@ -3,42 +3,204 @@
 
 #include <Text/type.h>
 
-void loadASCIIGlyphs(const FT_Face & face, GlyphMap & g){
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+
+const char GLYPH_ATLAS_MAGIC[8] = {'J','E','R','B','O','A','G','A'};
+const uint32_t GLYPH_ATLAS_VERSION = 1;
+const uint32_t GLYPH_ATLAS_WIDTH = 512;
+
+/*
+  Glyph atlas cache layout, little endian
+
+    GlyphAtlasHeader
+    ASCII_GLYPHS x GlyphRecord
+    atlasWidth*atlasHeight bytes of GL_RED pixels, rows top down
+
+  The font file's size and modification time are kept so a changed
+  font is rasterised again.
+*/
+struct GlyphAtlasHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t pixelSize;
+  uint64_t fontBytes;
+  int64_t fontModified;
+  uint32_t atlasWidth;
+  uint32_t atlasHeight;
+};
+
+struct GlyphRecord {
+  int32_t size[2];
+  int32_t bearing[2];
+  uint32_t x;                                                                     // top left in the atlas
+  uint32_t y;
+  uint64_t advance;
+};
+
+// place a glyph whose bitmap is at x,y in a w x h atlas
+void setGlyphUV(Glyph & g, uint32_t x, uint32_t y, uint32_t w, uint32_t h){
+  g.uvMin = glm::vec2(float(x)/w,float(y)/h);
+  g.uvMax = glm::vec2(float(x+g.size.x)/w,float(y+g.size.y)/h);
+}
+
+void loadASCIIGlyphs(
+  const FT_Face & face,
+  Glyph * g,
+  std::vector<uint8_t> & atlas,
+  uint32_t & atlasWidth,
+  uint32_t & atlasHeight
+){
   // have a look at this https://learnopengl.com/In-Practice/Text-Rendering
   // Some modifications have been made, e.g to render \n characters as line breaks
 
-  for (unsigned char c = 0; c < 128; c++/*ayy lmao*/){
+  // rasterise everything first, the atlas height depends on the packing
+  std::vector<std::vector<uint8_t>> bitmaps(ASCII_GLYPHS);
+  for (unsigned char c = 0; c < ASCII_GLYPHS; c++/*ayy lmao*/){
     if (FT_Load_Char(face, c, FT_LOAD_RENDER)){
       std::cout << "Failed to load glyph " << c << " from ASCII charset\n";
       continue;
     }
-    GLuint tex;
-    glGenTextures(1,&tex);
-    glBindTexture(GL_TEXTURE_2D,tex);
-    glTexImage2D(
-      GL_TEXTURE_2D,
-      0,
-      GL_RED,
-      face->glyph->bitmap.width,
-      face->glyph->bitmap.rows,
-      0,
-      GL_RED,
-      GL_UNSIGNED_BYTE,
-      face->glyph->bitmap.buffer
-    );
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    Glyph glyph(
-      tex,
-      glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
+    FT_Bitmap & b = face->glyph->bitmap;
+    bitmaps[c].resize(b.width*b.rows);
+    for (unsigned r = 0; r < b.rows; r++){
+      std::memcpy(&bitmaps[c][r*b.width],b.buffer+r*b.pitch,b.width);           // pitch may be padded
+    }
+    g[c] = Glyph(
+      glm::ivec2(b.width, b.rows),
       glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-      face->glyph->advance.x
+      face->glyph->advance.x,
+      glm::vec2(0.0,0.0),
+      glm::vec2(0.0,0.0)
+    );
+  }
+
+  // shelves left to right, a pixel of padding so linear filtering never
+  // bleeds a neighbour in
+  atlasWidth = GLYPH_ATLAS_WIDTH;
+  std::vector<uint32_t> x(ASCII_GLYPHS), y(ASCII_GLYPHS);
+  uint32_t penX = 1, penY = 1, shelf = 0;
+  for (unsigned c = 0; c < ASCII_GLYPHS; c++){
+    uint32_t w = g[c].size.x, h = g[c].size.y;
+    if (penX+w+1 > atlasWidth){
+      penX = 1;
+      penY += shelf+1;
+      shelf = 0;
+    }
+    x[c] = penX;
+    y[c] = penY;
+    penX += w+1;
+    shelf = std::max(shelf,h);
+  }
+  atlasHeight = penY+shelf+1;
+
+  atlas.assign(atlasWidth*atlasHeight,0);
+  for (unsigned c = 0; c < ASCII_GLYPHS; c++){
+    for (int r = 0; r < g[c].size.y; r++){
+      std::memcpy(&atlas[(y[c]+r)*atlasWidth+x[c]],&bitmaps[c][r*g[c].size.x],g[c].size.x);
+    }
+    setGlyphUV(g[c],x[c],y[c],atlasWidth,atlasHeight);
+  }
+}
+
+bool fontStamp(std::string font, uint64_t & bytes, int64_t & modified){
+  struct stat s;
+  if (stat(font.c_str(),&s) != 0){return false;}
+  bytes = s.st_size;
+  modified = s.st_mtime;
+  return true;
+}
+
+bool readGlyphAtlas(
+  std::string cache,
+  std::string font,
+  uint8_t pixelSize,
+  Glyph * g,
+  std::vector<uint8_t> & atlas,
+  uint32_t & atlasWidth,
+  uint32_t & atlasHeight
+){
+  uint64_t bytes;
+  int64_t modified;
+  if (!fontStamp(font,bytes,modified)){return false;}
+
+  FILE * file = fopen(cache.c_str(),"rb");
+  if (file == nullptr){return false;}
+
+  GlyphAtlasHeader header;
+  GlyphRecord records[ASCII_GLYPHS];
+  bool ok = fread(&header,sizeof(header),1,file) == 1 &&
+    std::memcmp(header.magic,GLYPH_ATLAS_MAGIC,sizeof(header.magic)) == 0 &&
+    header.version == GLYPH_ATLAS_VERSION &&
+    header.pixelSize == pixelSize &&
+    header.fontBytes == bytes &&
+    header.fontModified == modified &&
+    header.atlasWidth > 0 && header.atlasWidth <= 4096 &&
+    header.atlasHeight > 0 && header.atlasHeight <= 4096 &&
+    fread(records,sizeof(GlyphRecord),ASCII_GLYPHS,file) == ASCII_GLYPHS;
+
+  if (ok){
+    atlasWidth = header.atlasWidth;
+    atlasHeight = header.atlasHeight;
+    atlas.resize(atlasWidth*atlasHeight);
+    ok = fread(atlas.data(),1,atlas.size(),file) == atlas.size();
+  }
+  fclose(file);
+  if (!ok){return false;}
+
+  for (unsigned c = 0; c < ASCII_GLYPHS; c++){
+    GlyphRecord & r = records[c];
+    if (r.x+r.size[0] > atlasWidth || r.y+r.size[1] > atlasHeight){return false;}
+    g[c] = Glyph(
+      glm::ivec2(r.size[0],r.size[1]),
+      glm::ivec2(r.bearing[0],r.bearing[1]),
+      r.advance,
+      glm::vec2(0.0,0.0),
+      glm::vec2(0.0,0.0)
     );
-    glError("Loading Glyph: "+std::to_string(c)+" :");
-    g.insert(std::pair<char, Glyph>(c,glyph));
+    setGlyphUV(g[c],r.x,r.y,atlasWidth,atlasHeight);
+  }
+  return true;
+}
+
+// best effort, a read only font directory just means no cache
+void writeGlyphAtlas(
+  std::string cache,
+  std::string font,
+  uint8_t pixelSize,
+  Glyph * g,
+  std::vector<uint8_t> & atlas,
+  uint32_t atlasWidth,
+  uint32_t atlasHeight
+){
+  GlyphAtlasHeader header;
+  std::memset(&header,0,sizeof(header));
+  if (!fontStamp(font,header.fontBytes,header.fontModified)){return;}
+  std::memcpy(header.magic,GLYPH_ATLAS_MAGIC,sizeof(header.magic));
+  header.version = GLYPH_ATLAS_VERSION;
+  header.pixelSize = pixelSize;
+  header.atlasWidth = atlasWidth;
+  header.atlasHeight = atlasHeight;
+
+  GlyphRecord records[ASCII_GLYPHS];
+  for (unsigned c = 0; c < ASCII_GLYPHS; c++){
+    records[c].size[0] = g[c].size.x;
+    records[c].size[1] = g[c].size.y;
+    records[c].bearing[0] = g[c].bearing.x;
+    records[c].bearing[1] = g[c].bearing.y;
+    records[c].x = uint32_t(g[c].uvMin.x*atlasWidth+0.5);
+    records[c].y = uint32_t(g[c].uvMin.y*atlasHeight+0.5);
+    records[c].advance = g[c].offset;
   }
+
+  FILE * file = fopen(cache.c_str(),"wb");
+  if (file == nullptr){return;}
+  fwrite(&header,sizeof(header),1,file);
+  fwrite(records,sizeof(GlyphRecord),ASCII_GLYPHS,file);
+  fwrite(atlas.data(),1,atlas.size(),file);
+  fclose(file);
 }
 
 // forces the number x to be rendered in exactly length characters as a string
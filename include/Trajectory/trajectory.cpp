@@ -0,0 +1,206 @@
+#include <Trajectory/trajectory.h>
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+TrajectoryWriter::TrajectoryWriter(
+  std::string path,
+  uint64_t nParticles,
+  float dt,
+  float density,
+  float radius,
+  uint32_t stepsPerFrame
+){
+  std::memset(&header,0,sizeof(header));
+  std::memcpy(header.magic,TRAJECTORY_MAGIC,sizeof(header.magic));
+  header.version = TRAJECTORY_VERSION;
+  header.stride = 3;
+  header.nParticles = nParticles;
+  header.nFrames = 0;
+  header.dt = dt;
+  header.density = density;
+  header.radius = radius;
+  header.stepsPerFrame = stepsPerFrame;
+
+  file = fopen(path.c_str(),"wb");
+  if (file == nullptr){
+    std::cout << "Could not open trajectory for writing: " << path << "\n";
+    return;
+  }
+  fwrite(&header,sizeof(header),1,file);
+}
+
+void TrajectoryWriter::write(const float * frame){
+  if (file == nullptr){return;}
+  TraceScope trace("io/trajectory");
+  double tic = wallClock();
+  uint64_t n = header.nParticles*header.stride;
+  if (fwrite(frame,sizeof(float),n,file) != n){
+    std::cout << "Failed writing trajectory frame " << header.nFrames << "\n";
+    return;
+  }
+  header.nFrames++;
+  telemetry().record(Metric::IO,wallClock()-tic);
+}
+
+void TrajectoryWriter::close(){
+  if (file == nullptr){return;}
+  // frame count is only known now, patch the header
+  fseek(file,0,SEEK_SET);
+  fwrite(&header,sizeof(header),1,file);
+  fclose(file);
+  file = nullptr;
+}
+
+TrajectoryReader::TrajectoryReader(std::string path, uint64_t prefetchBytes)
+: data(nullptr), length(0), running(false), requested(false),
+  requestFrame(0), requestDirection(1), residentFirst(0), residentLast(0)
+{
+  pageSize = sysconf(_SC_PAGESIZE);
+
+  int fd = open(path.c_str(),O_RDONLY);
+  if (fd < 0){
+    std::cout << "Could not open trajectory: " << path << "\n";
+    return;
+  }
+
+  struct stat s;
+  if (fstat(fd,&s) != 0 || uint64_t(s.st_size) < sizeof(TrajectoryHeader)){
+    std::cout << "Not a trajectory (too small): " << path << "\n";
+    ::close(fd);
+    return;
+  }
+
+  length = s.st_size;
+  void * m = mmap(nullptr,length,PROT_READ,MAP_SHARED,fd,0);
+  ::close(fd);                                                                    // the mapping keeps the file alive
+  if (m == MAP_FAILED){
+    std::cout << "Could not map trajectory: " << path << "\n";
+    return;
+  }
+
+  std::memcpy(&header,m,sizeof(header));
+  if (std::memcmp(header.magic,TRAJECTORY_MAGIC,sizeof(header.magic)) != 0 ||
+      header.version != TRAJECTORY_VERSION ||
+      header.stride != 3 ||
+      header.nParticles == 0){
+    std::cout << "Not a trajectory (bad header): " << path << "\n";
+    munmap(m,length);
+    return;
+  }
+
+  // not even one frame's worth of particles, checked before frameBytes() can overflow
+  if (header.nParticles > (length-sizeof(TrajectoryHeader))/(3*sizeof(float))){
+    std::cout << "Trajectory has no frames: " << path << "\n";
+    munmap(m,length);
+    return;
+  }
+
+  // a recording that was never closed still has nFrames = 0, trust the file size
+  uint64_t available = (length-sizeof(TrajectoryHeader))/frameBytes();
+  if (header.nFrames == 0 || header.nFrames > available){
+    header.nFrames = available;
+  }
+
+  data = (const uint8_t*)m;
+  prefetchFrames = std::max(uint64_t(2),prefetchBytes/frameBytes());
+
+  running = true;
+  worker = std::thread(&TrajectoryReader::prefetchLoop,this);
+}
+
+TrajectoryReader::~TrajectoryReader(){
+  if (running){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+    }
+    wake.notify_one();
+    worker.join();
+  }
+  if (data != nullptr){
+    munmap((void*)data,length);
+  }
+}
+
+const float * TrajectoryReader::frame(uint64_t i){
+  i = std::min(i,header.nFrames-1);
+  return (const float*)(data+sizeof(TrajectoryHeader)+i*frameBytes());
+}
+
+void TrajectoryReader::prefetch(uint64_t i, int direction){
+  // cheap exit, most calls land well inside the resident window
+  uint64_t margin = prefetchFrames/2;
+  if (direction >= 0 && i >= residentFirst && i+margin < residentLast){return;}
+  if (direction < 0 && i < residentLast && i >= residentFirst+margin){return;}
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    requested = true;
+    requestFrame = i;
+    requestDirection = direction;
+  }
+  wake.notify_one();
+}
+
+void TrajectoryReader::touch(uint64_t first, uint64_t last){
+  if (first >= last){return;}
+  TraceScope trace("io/prefetch");
+  uint64_t begin = sizeof(TrajectoryHeader)+first*frameBytes();
+  uint64_t end = std::min(length,sizeof(TrajectoryHeader)+last*frameBytes());
+  begin -= begin % pageSize;
+
+  madvise((void*)(data+begin),end-begin,MADV_WILLNEED);
+  // madvise is only a hint, fault the pages in ourselves so the renderer never does
+  volatile uint8_t sink = 0;
+  for (uint64_t b = begin; b < end; b += pageSize){
+    sink += data[b];
+  }
+  (void)sink;
+}
+
+void TrajectoryReader::prefetchLoop(){
+  tracer().nameThread("prefetch");
+  while (true){
+    uint64_t i;
+    int direction;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock,[this]{return requested || !running;});
+      if (!running){return;}
+      requested = false;
+      i = requestFrame;
+      direction = requestDirection;
+    }
+
+    uint64_t first, last;
+    if (direction >= 0){
+      first = i;
+      last = std::min(header.nFrames,i+prefetchFrames);
+    }
+    else{
+      first = i+1 > prefetchFrames ? i+1-prefetchFrames : 0;
+      last = std::min(header.nFrames,i+1);
+    }
+
+    // only fetch what is not already resident
+    uint64_t rf = residentFirst, rl = residentLast;
+    if (first >= rf && first < rl){
+      touch(rl,last);
+    }
+    else if (last > rf && last <= rl){
+      touch(first,rf);
+    }
+    else{
+      touch(first,last);
+    }
+
+    residentFirst = first;
+    residentLast = last;
+  }
+}
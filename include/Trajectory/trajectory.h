@@ -0,0 +1,116 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include <telemetry.h>
+#include <trace.h>
+
+/*
+  On disk trajectory format
+
+  [TrajectoryHeader][frame 0][frame 1]...[frame nFrames-1]
+
+  each frame is nParticles*stride floats laid out exactly as
+  ParticleSystem::state, i.e x,y,theta per particle, so a
+  mapped frame can go straight into the instanced draw path.
+*/
+
+const char TRAJECTORY_MAGIC[8] = {'J','E','R','B','O','A','T','R'};
+const uint32_t TRAJECTORY_VERSION = 1;
+
+struct TrajectoryHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t stride;                                                                // floats per particle
+  uint64_t nParticles;
+  uint64_t nFrames;
+  float dt;
+  float density;
+  float radius;
+  uint32_t stepsPerFrame;                                                         // simulation steps between frames
+  uint8_t padding[16];
+};
+
+static_assert(sizeof(TrajectoryHeader) == 64, "TrajectoryHeader must be 64 bytes");
+
+class TrajectoryWriter {
+public:
+
+  TrajectoryWriter(
+    std::string path,
+    uint64_t nParticles,
+    float dt,
+    float density,
+    float radius,
+    uint32_t stepsPerFrame
+  );
+
+  ~TrajectoryWriter(){close();}
+
+  bool isOpen(){return file != nullptr;}
+  uint64_t frames(){return header.nFrames;}
+
+  void write(const float * frame);
+  void close();
+
+private:
+  FILE * file;
+  TrajectoryHeader header;
+};
+
+/*
+  Read only memory mapped view of a trajectory file.
+
+  A background thread keeps the frames ahead of the play head
+  resident (madvise + touching a byte per page) so playback
+  never blocks on disk in the render loop.
+*/
+class TrajectoryReader {
+public:
+
+  TrajectoryReader(std::string path, uint64_t prefetchBytes = uint64_t(256)<<20);
+  ~TrajectoryReader();
+
+  bool isOpen(){return data != nullptr;}
+
+  const TrajectoryHeader & getHeader(){return header;}
+  uint64_t nFrames(){return header.nFrames;}
+  uint64_t nParticles(){return header.nParticles;}
+  uint64_t frameBytes(){return header.nParticles*header.stride*sizeof(float);}
+
+  const float * frame(uint64_t i);
+
+  // hint the reader that frames from i onwards in direction (+1/-1) are next
+  void prefetch(uint64_t i, int direction = 1);
+
+private:
+
+  void prefetchLoop();
+  void touch(uint64_t first, uint64_t last);
+
+  TrajectoryHeader header;
+  const uint8_t * data;
+  uint64_t length;
+  uint64_t pageSize;
+  uint64_t prefetchFrames;
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool running;
+  bool requested;
+  uint64_t requestFrame;
+  int requestDirection;
+
+  // range [first,last) known to be resident
+  std::atomic<uint64_t> residentFirst, residentLast;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef COMMANDQUEUE_H
+#define COMMANDQUEUE_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/*
+  Multiple producer, single consumer queue of edits. The consumer
+  takes everything pending in one swap at a safe point (e.g between
+  simulation steps) so producers only hold the lock for a push.
+*/
+template <class T>
+class CommandQueue {
+public:
+
+  void push(T command){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.push_back(command);
+    }
+    wake.notify_one();
+  }
+
+  // move everything pending into out (cleared first)
+  bool drain(std::vector<T> & out){
+    out.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    out.swap(pending);
+    return !out.empty();
+  }
+
+  // as drain, but block for up to timeout when nothing is pending
+  template <class Rep, class Period>
+  bool wait(std::vector<T> & out, std::chrono::duration<Rep,Period> timeout){
+    out.clear();
+    std::unique_lock<std::mutex> lock(mutex);
+    wake.wait_for(lock,timeout,[this]{return !pending.empty() || interrupted;});
+    interrupted = false;
+    out.swap(pending);
+    return !out.empty();
+  }
+
+  // release a consumer blocked in wait without queueing anything
+  void interrupt(){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      interrupted = true;
+    }
+    wake.notify_one();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::vector<T> pending;
+  bool interrupted = false;
+};
+
+#endif
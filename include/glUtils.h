@@ -2,7 +2,7 @@
 #define GLUTILS_H
 
 // print buffer status errors
-GLuint glBufferStatus(const std::string c = ""){
+inline GLuint glBufferStatus(const std::string c = ""){
     GLuint e = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (e != GL_FRAMEBUFFER_COMPLETE){std::cout << c; return e;}
     switch(e){
@@ -29,7 +29,7 @@ GLuint glBufferStatus(const std::string c = ""){
 }
 
 // print gl error codes
-GLuint glError(const std::string c = ""){
+inline GLuint glError(const std::string c = ""){
     GLuint e = glGetError();
     if (e != GL_NO_ERROR){std::cout << c;}
     switch(e){
@@ -55,7 +55,7 @@ GLuint glError(const std::string c = ""){
 }
 
 // compile a gl shader given a program and source code as const char *
-void compileShader(GLuint & shaderProgram, const char * vert, const char * frag){
+inline void compileShader(GLuint & shaderProgram, const char * vert, const char * frag){
 
     GLuint vertexShader;
     vertexShader = glCreateShader(GL_VERTEX_SHADER);
@@ -0,0 +1,117 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <cstdint>
+
+#include <telemetry.h>
+
+enum GpuPass : uint8_t {
+  GPU_PARTICLES,                                                                  // points, density field and heatmap
+  GPU_TOYS,
+  GPU_BOX,
+  GPU_TEXT,                                                                       // labels and the overlay graph
+  GPU_PASSES
+};
+
+inline Metric gpuMetric(GpuPass p){
+  switch (p){
+    case GPU_PARTICLES: return Metric::GPU_PARTICLES;
+    case GPU_TOYS: return Metric::GPU_TOYS;
+    case GPU_BOX: return Metric::GPU_BOX;
+    default: return Metric::GPU_TEXT;
+  }
+}
+
+/*
+  GPU time per render pass through GL_TIME_ELAPSED queries, recorded
+  into telemetry.
+
+  Each frame uses its own set of queries from a ring latency frames
+  deep and reads back the set it is about to reuse, by then long
+  finished, so nothing ever waits on the GPU. A result still pending
+  after latency frames is dropped rather than waited for. Queries of
+  this type cannot overlap, passes are timed one after another, each
+  at most once a frame. Until initialise() (e.g headless) every call
+  is a no-op.
+*/
+class GpuTimers {
+public:
+
+  static const uint8_t latency = 4;
+
+  GpuTimers()
+  : ready(false), active(false), slot(0), lost(0) {}
+
+  void initialise(){
+    glGenQueries(latency*GPU_PASSES,&queries[0][0]);
+    for (uint8_t s = 0; s < latency; s++){
+      for (uint8_t p = 0; p < GPU_PASSES; p++){used[s][p] = false;}
+    }
+    ready = true;
+    glError("GpuTimers initialise");
+  }
+
+  // call once a frame before any pass
+  void beginFrame(){
+    if (!ready){return;}
+    slot = (slot+1) % latency;
+    collect(slot);
+  }
+
+  void begin(GpuPass p){
+    if (!ready || active){return;}
+    glBeginQuery(GL_TIME_ELAPSED,queries[slot][p]);
+    active = true;
+    current = p;
+  }
+
+  void end(GpuPass p){
+    if (!ready || !active || current != p){return;}
+    glEndQuery(GL_TIME_ELAPSED);
+    used[slot][p] = true;
+    active = false;
+  }
+
+  bool isReady(){return ready;}
+  // results given up on because the GPU was a whole ring behind
+  uint64_t dropped(){return lost;}
+
+private:
+
+  void collect(uint8_t s){
+    double total = 0.0;
+    bool any = false;
+    for (uint8_t p = 0; p < GPU_PASSES; p++){
+      if (!used[s][p]){continue;}
+      used[s][p] = false;
+      GLint available = 0;
+      glGetQueryObjectiv(queries[s][p],GL_QUERY_RESULT_AVAILABLE,&available);
+      if (!available){
+        lost++;
+        continue;
+      }
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(queries[s][p],GL_QUERY_RESULT,&ns);
+      telemetry().record(gpuMetric(GpuPass(p)),ns*1e-9);
+      total += ns*1e-9;
+      any = true;
+    }
+    if (any){telemetry().record(Metric::GPU,total);}
+  }
+
+  GLuint queries[latency][GPU_PASSES];
+  bool used[latency][GPU_PASSES];
+  bool ready;
+  bool active;
+  GpuPass current;
+  uint8_t slot;
+  uint64_t lost;
+};
+
+// the render thread's timers, shared by main and the particle renderer
+inline GpuTimers & gpuTimers(){
+  static GpuTimers timers;
+  return timers;
+}
+
+#endif
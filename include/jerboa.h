@@ -0,0 +1,72 @@
+#ifndef JERBOA_H
+#define JERBOA_H
+
+#include <stdint.h>
+
+/*
+  C interface to the simulation core, libjerboa.
+
+  A jerboa_system is one ParticleSystem with no window or GPU. The
+  positions view points straight into the live x,y,theta array, no
+  copy is made, so e.g numpy can wrap it once. jerboa_step_n updates
+  those floats in place, and a view stays valid until jerboa_destroy.
+
+  Systems are independent, each has its own random stream, but one
+  system must not be used from two threads at once.
+
+  Nothing is written to stdout, a failing call returns NULL or -1 and
+  jerboa_last_error says why.
+*/
+
+#if defined(__GNUC__)
+#define JERBOA_API __attribute__((visibility("default")))
+#else
+#define JERBOA_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct jerboa_system jerboa_system;
+
+enum jerboa_toy {
+  JERBOA_ATTRACTOR = 0,
+  JERBOA_REPELLER = 1
+};
+
+typedef struct {
+  const float * data;                                                             /* x,y,theta per particle */
+  uint64_t particles;
+  uint64_t stride;                                                                /* floats per particle */
+  uint64_t step;                                                                  /* steps taken at the time */
+} jerboa_view;
+
+/* n randomly placed particles in the unit box, NULL on failure
+   (including dt or density not finite and > 0) */
+JERBOA_API jerboa_system * jerboa_create(uint64_t particles, float dt, float density, uint64_t seed);
+/* start from particles x,y,theta triples instead */
+JERBOA_API jerboa_system * jerboa_create_from(uint64_t particles, const float * initial, float dt, float density, uint64_t seed);
+JERBOA_API void jerboa_destroy(jerboa_system * system);
+
+/* 0 on success, -1 if a step failed (e.g out of memory), the state is then partial */
+JERBOA_API int jerboa_step_n(jerboa_system * system, uint64_t steps);
+
+/* 0 on success, -1 for an unknown jerboa_toy or on failure */
+JERBOA_API int jerboa_add_toy(jerboa_system * system, int toy, float x, float y);
+/* removes a toy near x,y, 1 if one was found, -1 on failure */
+JERBOA_API int jerboa_remove_toy(jerboa_system * system, float x, float y);
+
+/* why the last call on this thread failed, "" before any failure, never printed */
+JERBOA_API const char * jerboa_last_error(void);
+
+JERBOA_API jerboa_view jerboa_get_positions_view(jerboa_system * system);
+
+JERBOA_API uint64_t jerboa_steps(jerboa_system * system);
+JERBOA_API float jerboa_radius(jerboa_system * system);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
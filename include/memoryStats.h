@@ -0,0 +1,110 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iomanip>
+
+#include <sys/resource.h>
+
+// one allocation, bytes in use against bytes held
+struct MemoryEntry {
+  std::string name;
+  uint64_t used;
+  uint64_t capacity;
+  bool gpu;
+};
+
+template <class T>
+MemoryEntry vectorMemory(std::string name, const std::vector<T> & v){
+  return {name,v.size()*sizeof(T),v.capacity()*sizeof(T),false};
+}
+
+struct MemoryReport {
+  std::vector<MemoryEntry> entries;
+  uint64_t particles = 0;
+  uint64_t rss = 0;
+  uint64_t peakRss = 0;
+
+  uint64_t total(bool gpu, bool capacity = true) const {
+    uint64_t t = 0;
+    for (const MemoryEntry & e : entries){
+      if (e.gpu == gpu){t += capacity ? e.capacity : e.used;}
+    }
+    return t;
+  }
+
+  double bytesPerParticle() const {return particles > 0 ? double(total(false))/particles : 0.0;}
+};
+
+// resident and peak resident bytes of this process, 0 where unknown
+inline void processMemory(uint64_t & rss, uint64_t & peakRss){
+  rss = 0;
+  peakRss = 0;
+  FILE * status = fopen("/proc/self/status","r");
+  if (status != nullptr){
+    char line[256];
+    unsigned long long kB;
+    while (fgets(line,sizeof(line),status) != nullptr){
+      if (sscanf(line,"VmRSS: %llu kB",&kB) == 1){rss = kB*1024;}
+      if (sscanf(line,"VmHWM: %llu kB",&kB) == 1){peakRss = kB*1024;}
+    }
+    fclose(status);
+  }
+  if (peakRss == 0){
+    rusage usage;
+    if (getrusage(RUSAGE_SELF,&usage) == 0){
+#ifdef __APPLE__
+      peakRss = usage.ru_maxrss;                                                  // already bytes
+#else
+      peakRss = uint64_t(usage.ru_maxrss)*1024;
+#endif
+    }
+  }
+}
+
+inline std::string formatBytes(uint64_t bytes){
+  const char * units[] = {"B","KiB","MiB","GiB","TiB"};
+  double b = double(bytes);
+  uint8_t u = 0;
+  while (b >= 1024.0 && u < 4){
+    b /= 1024.0;
+    u++;
+  }
+  char s[32];
+  snprintf(s,sizeof(s),u == 0 ? "%.0f %s" : "%.1f %s",b,units[u]);
+  return std::string(s);
+}
+
+inline void printMemoryReport(std::ostream & out, const MemoryReport & r){
+  out << std::left << std::setw(24) << "allocation" << std::setw(14) << "used" << "capacity\n";
+  for (const MemoryEntry & e : r.entries){
+    out << std::setw(24) << (e.gpu ? "[gpu] "+e.name : e.name)
+      << std::setw(14) << formatBytes(e.used) << formatBytes(e.capacity) << "\n";
+  }
+  out << std::right;
+  out << "Host " << formatBytes(r.total(false)) << " (" << r.bytesPerParticle() << " B/particle), GPU "
+    << formatBytes(r.total(true)) << ", RSS " << formatBytes(r.rss) << " (peak " << formatBytes(r.peakRss) << ")\n";
+}
+
+inline void writeMemoryJSON(std::ostream & out, const MemoryReport & r){
+  out << "{\"particles\":" << r.particles
+    << ",\"host_bytes\":" << r.total(false)
+    << ",\"gpu_bytes\":" << r.total(true)
+    << ",\"bytes_per_particle\":" << r.bytesPerParticle()
+    << ",\"rss\":" << r.rss
+    << ",\"peak_rss\":" << r.peakRss
+    << ",\"allocations\":[";
+  for (uint64_t i = 0; i < r.entries.size(); i++){
+    const MemoryEntry & e = r.entries[i];
+    out << (i == 0 ? "" : ",") << "{\"name\":\"" << e.name << "\",\"gpu\":" << (e.gpu ? "true" : "false")
+      << ",\"used\":" << e.used << ",\"capacity\":" << e.capacity << "}";
+  }
+  out << "]}";
+}
+
+#endif
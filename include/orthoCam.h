@@ -3,6 +3,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 
 /*
   An orthographic camera.
@@ -33,6 +34,14 @@ public:
     return invProjection*nvd;
   }
 
+  // world space rectangle covered by the viewport
+  void visibleRegion(glm::vec2 & lower, glm::vec2 & upper){
+    glm::vec4 a = screenToWorld(0.0,resolution.y);
+    glm::vec4 b = screenToWorld(resolution.x,0.0);
+    lower = glm::vec2(std::min(a.x,b.x),std::min(a.y,b.y));
+    upper = glm::vec2(std::max(a.x,b.x),std::max(a.y,b.y));
+  }
+
   glm::mat4 getVP(){return vp;}
   glm::mat4 getProjection(){return projection;}
   float getZoomLevel(){return zoomLevel;}
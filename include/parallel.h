@@ -0,0 +1,52 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// number of worker threads to use when none is asked for
+inline unsigned defaultThreads(){
+  unsigned n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+/*
+  Split [begin,end) into contiguous chunks, one per thread, and
+  call f(first,last,thread) for each. Chunks let workers keep
+  thread local accumulators and merge them afterwards.
+*/
+template <class F>
+void parallelFor(uint64_t begin, uint64_t end, F f, unsigned nThreads = 0){
+  if (end <= begin){return;}
+  if (nThreads == 0){nThreads = defaultThreads();}
+  uint64_t n = end-begin;
+  nThreads = unsigned(std::min(uint64_t(nThreads),n));
+
+  if (nThreads == 1){
+    f(begin,end,0u);
+    return;
+  }
+
+  uint64_t chunk = n/nThreads;
+  uint64_t extra = n%nThreads;
+
+  std::vector<std::thread> workers;
+  uint64_t first = begin;
+  for (unsigned t = 0; t < nThreads; t++){
+    uint64_t last = first+chunk+(t < extra ? 1 : 0);
+    if (t == nThreads-1){
+      f(first,last,t);                                                            // the caller does the last chunk
+    }
+    else{
+      workers.push_back(std::thread(f,first,last,t));
+    }
+    first = last;
+  }
+  for (unsigned t = 0; t < workers.size(); t++){
+    workers[t].join();
+  }
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+enum PerfCounter {
+  CYCLES,
+  INSTRUCTIONS,
+  LLC_MISSES,
+  BRANCH_MISSES,
+  PERF_COUNTERS
+};
+
+struct PerfSample {
+  uint64_t counts[PERF_COUNTERS] = {0,0,0,0};
+
+  PerfSample & operator+=(const PerfSample & s){
+    for (uint8_t c = 0; c < PERF_COUNTERS; c++){counts[c] += s.counts[c];}
+    return *this;
+  }
+};
+
+inline PerfSample operator-(const PerfSample & a, const PerfSample & b){
+  PerfSample d;
+  // scaled multiplexed counts can step back a little
+  for (uint8_t c = 0; c < PERF_COUNTERS; c++){d.counts[c] = a.counts[c] > b.counts[c] ? a.counts[c]-b.counts[c] : 0;}
+  return d;
+}
+
+/*
+  Hardware counters for the calling thread through perf_event_open,
+  so open() must be called on the thread to be measured.
+
+  Each counter is opened on its own rather than as a group, a VM or
+  CPU lacking, say, LLC misses still gives cycles and instructions.
+  Counters that would not open read as 0 and have(c) says so; with
+  none at all (no Linux, perf_event_paranoid, containers) available()
+  is false and read() is a no-op. Multiplexed counts are scaled up by
+  enabled over running time.
+*/
+class PerfCounters {
+public:
+
+  PerfCounters(){
+    for (uint8_t c = 0; c < PERF_COUNTERS; c++){fds[c] = -1;}
+  }
+
+  ~PerfCounters(){close();}
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters & operator=(const PerfCounters &) = delete;
+
+  bool open(){
+    close();
+#ifdef __linux__
+    const uint64_t config[PERF_COUNTERS] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES,                                                 // last level on most cores
+      PERF_COUNT_HW_BRANCH_MISSES
+    };
+    for (uint8_t c = 0; c < PERF_COUNTERS; c++){
+      perf_event_attr attr;
+      std::memset(&attr,0,sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = config[c];
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[c] = int(syscall(SYS_perf_event_open,&attr,0,-1,-1,0));
+    }
+#endif
+    if (!available()){
+      std::cout << "Hardware counters unavailable (check /proc/sys/kernel/perf_event_paranoid)\n";
+    }
+    return available();
+  }
+
+  void close(){
+#ifdef __linux__
+    for (uint8_t c = 0; c < PERF_COUNTERS; c++){
+      if (fds[c] >= 0){::close(fds[c]);}
+      fds[c] = -1;
+    }
+#endif
+  }
+
+  bool have(PerfCounter c){return fds[c] >= 0;}
+
+  bool available(){
+    for (uint8_t c = 0; c < PERF_COUNTERS; c++){
+      if (fds[c] >= 0){return true;}
+    }
+    return false;
+  }
+
+  // running totals since open(), differences of two reads give a phase
+  PerfSample read(){
+    PerfSample s;
+#ifdef __linux__
+    for (uint8_t c = 0; c < PERF_COUNTERS; c++){
+      if (fds[c] < 0){continue;}
+      uint64_t v[3];                                                              // value, enabled, running
+      if (::read(fds[c],v,sizeof(v)) != sizeof(v)){continue;}
+      s.counts[c] = (v[2] > 0 && v[2] < v[1]) ? uint64_t(double(v[0])*v[1]/v[2]) : v[0];
+    }
+#endif
+    return s;
+  }
+
+private:
+  int fds[PERF_COUNTERS];
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef RENDERTARGET_H
+#define RENDERTARGET_H
+
+#include <cstdint>
+#include <algorithm>
+
+/*
+  An offscreen colour buffer the scene can be drawn into at less than
+  window resolution, then stretched onto the window with a linear
+  filtered blit.
+
+  usage per frame:
+    target.bind();  // viewport is now width() x height()
+    // ... draw the scene ...
+    target.blit(resX,resY);  // back on the window's framebuffer
+*/
+class RenderTarget {
+public:
+
+  RenderTarget()
+  : fbo(0), colour(0), w(0), h(0) {}
+
+  ~RenderTarget(){release();}
+
+  // (re)allocate at w x h pixels, a no-op if the size is unchanged
+  void resize(uint32_t width, uint32_t height){
+    if (width == w && height == h && fbo != 0){return;}
+    release();
+    w = std::max(width,uint32_t(1));
+    h = std::max(height,uint32_t(1));
+
+    glGenFramebuffers(1,&fbo);
+    glGenRenderbuffers(1,&colour);
+    glBindRenderbuffer(GL_RENDERBUFFER,colour);
+    glRenderbufferStorage(GL_RENDERBUFFER,GL_RGBA8,w,h);
+    glBindRenderbuffer(GL_RENDERBUFFER,0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_RENDERBUFFER,colour);
+    glBufferStatus("RenderTarget resize");
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    glError("RenderTarget resize");
+  }
+
+  void bind(){
+    glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+    glViewport(0,0,w,h);
+  }
+
+  // upscale onto the default framebuffer and leave it bound
+  void blit(uint32_t resX, uint32_t resY){
+    glBindFramebuffer(GL_READ_FRAMEBUFFER,fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER,0);
+    glBlitFramebuffer(0,0,w,h,0,0,resX,resY,GL_COLOR_BUFFER_BIT,GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
+    glViewport(0,0,resX,resY);
+    glError("RenderTarget blit");
+  }
+
+  uint32_t width(){return w;}
+  uint32_t height(){return h;}
+
+private:
+
+  void release(){
+    if (fbo != 0){glDeleteFramebuffers(1,&fbo);}
+    if (colour != 0){glDeleteRenderbuffers(1,&colour);}
+    fbo = 0;
+    colour = 0;
+  }
+
+  GLuint fbo;
+  GLuint colour;
+  uint32_t w;
+  uint32_t h;
+};
+
+#endif
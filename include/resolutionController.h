@@ -0,0 +1,72 @@
+#ifndef RESOLUTIONCONTROLLER_H
+#define RESOLUTIONCONTROLLER_H
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <telemetry.h>
+
+/*
+  Picks a render scale (fraction of window resolution per axis) from
+  recent frame timings in the telemetry window.
+
+  With vsync a frame that makes its deadline always measures the full
+  frame time, so the two directions use different signals. The scale
+  drops when the tail of whole frame times (p95) shows missed refreshes,
+  by the square root of the overrun since cost goes with pixel count.
+  It only climbs back, one step at a time, when the tail of the time
+  spent actually working before the swap leaves clear headroom. After
+  any change a full window of samples must be collected at the new
+  scale before the next decision, which keeps it from oscillating.
+*/
+class ResolutionController {
+public:
+
+  ResolutionController(double target, float minScale = 0.25, float step = 0.05)
+  : target(target), minScale(minScale), step(step), s(1.0), cooldown(0), p95(0.0), workP95(0.0) {}
+
+  // reads Metric::FRAME (including the swap) and Metric::WORK (before it)
+  float update(Telemetry & t){
+    uint64_t n = t.window();
+    p95 = t.summary(Metric::FRAME,n).p95;
+    workP95 = t.summary(Metric::WORK,n).p95;
+
+    if (cooldown > 0){
+      cooldown--;
+      return s;
+    }
+
+    float next = s;
+    if (p95 > target*1.25){
+      next = std::min(s-step,s*float(std::sqrt(target/p95)));
+    }
+    else if (workP95 < target*0.6 && s < 1.0){
+      next = s+step;
+    }
+
+    // whole steps so the buffer is not reallocated for tiny changes
+    next = std::round(next/step)*step;
+    next = std::min(1.0f,std::max(minScale,next));
+    if (next != s){
+      s = next;
+      cooldown = n;
+    }
+    return s;
+  }
+
+  float scale(){return s;}
+  double frameP95(){return p95;}
+  double workTimeP95(){return workP95;}
+
+private:
+  double target;
+  float minScale;
+  float step;
+  float s;
+  uint64_t cooldown;
+  double p95;
+  double workP95;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef SHADERMANAGER_H
+#define SHADERMANAGER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sys/stat.h>
+
+#include <glm/glm.hpp>
+
+// uniform buffer binding point of the Camera block
+const GLuint CAMERA_BINDING = 0;
+
+const char SHADER_BINARY_MAGIC[8] = {'J','E','R','B','O','A','S','B'};
+
+/*
+  The std140 Camera block every world space shader declares,
+
+    layout(std140) uniform Camera { mat4 proj; float zoom; float resolution; };
+
+  resolution is the width in pixels being rendered to, so a world
+  length l covers l*resolution*zoom pixels.
+*/
+struct CameraBlock {
+  glm::mat4 proj;
+  float zoom;
+  float resolution;
+  float padding[2];
+};
+
+/*
+  Builds shader programs and owns the state they share.
+
+  Linked programs are cached on disk keyed by a hash of their source
+  and the GL renderer/version, and reloaded with glProgramBinary where
+  the driver supports it, skipping compilation at startup. Any cache
+  miss or rejected binary just compiles from source.
+
+  The camera lives in one uniform buffer bound to every program with
+  a Camera block, so a frame's projection is a single upload however
+  many programs draw with it. Uniform locations are meant to be looked
+  up once with location() and kept, not per frame.
+*/
+class ShaderManager {
+public:
+
+  ShaderManager()
+  : cameraBuffer(0), binaries(false), cacheHits(0), cacheMisses(0) {}
+
+  // needs a current context, cache "" to compile every time
+  void initialise(std::string cache){
+    cacheDirectory = cache;
+    GLint formats = 0;
+    if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary){
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&formats);
+    }
+    binaries = formats > 0 && cacheDirectory != "";
+    if (binaries){
+      mkdir(cacheDirectory.c_str(),0755);                                        // fine if it exists
+    }
+
+    const char * renderer = (const char*)glGetString(GL_RENDERER);
+    const char * version = (const char*)glGetString(GL_VERSION);
+    driver = std::string(renderer ? renderer : "")+std::string(version ? version : "");
+
+    glGenBuffers(1,&cameraBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER,cameraBuffer);
+    glBufferData(GL_UNIFORM_BUFFER,sizeof(CameraBlock),NULL,GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER,0);
+    glBindBufferBase(GL_UNIFORM_BUFFER,CAMERA_BINDING,cameraBuffer);
+    camera.proj = glm::mat4(0.0f);
+    camera.zoom = 0.0;
+    camera.resolution = 0.0;
+    glError("ShaderManager initialise");
+  }
+
+  // a linked program from source, or its cached binary
+  GLuint program(const char * vert, const char * frag){
+    GLuint p = glCreateProgram();
+    std::string path = binaryPath(vert,frag);
+
+    if (binaries && loadBinary(p,path)){
+      cacheHits++;
+    }
+    else{
+      if (binaries){
+        glProgramParameteri(p,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+      }
+      compileShader(p,vert,frag);
+      if (binaries){saveBinary(p,path);}
+      cacheMisses++;
+    }
+
+    GLuint block = glGetUniformBlockIndex(p,"Camera");
+    if (block != GL_INVALID_INDEX){
+      glUniformBlockBinding(p,block,CAMERA_BINDING);
+    }
+    glError("ShaderManager program");
+    return p;
+  }
+
+  GLint location(GLuint program, const char * name){
+    GLint l = glGetUniformLocation(program,name);
+    if (l == -1){std::cout << "No active uniform " << name << "\n";}
+    return l;
+  }
+
+  // one upload for every program, skipped if nothing moved
+  void setCamera(const glm::mat4 & proj, float zoom, float resolution){
+    if (
+      std::memcmp(&camera.proj[0][0],&proj[0][0],sizeof(float)*16) == 0 &&
+      camera.zoom == zoom &&
+      camera.resolution == resolution
+    ){
+      return;
+    }
+    camera.proj = proj;
+    camera.zoom = zoom;
+    camera.resolution = resolution;
+    glBindBuffer(GL_UNIFORM_BUFFER,cameraBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER,0,sizeof(CameraBlock),&camera);
+    glBindBuffer(GL_UNIFORM_BUFFER,0);
+  }
+
+  uint64_t binaryHits(){return cacheHits;}
+  uint64_t binaryMisses(){return cacheMisses;}
+
+private:
+
+  std::string binaryPath(const char * vert, const char * frag){
+    // FNV-1a over everything that could invalidate a binary
+    uint64_t h = 14695981039346656037ull;
+    std::string key = std::string(vert)+'\0'+std::string(frag)+'\0'+driver;
+    for (uint64_t i = 0; i < key.size(); i++){
+      h = (h ^ uint8_t(key[i]))*1099511628211ull;
+    }
+    char name[32];
+    snprintf(name,sizeof(name),"%016llx.bin",(unsigned long long)h);
+    return cacheDirectory+name;
+  }
+
+  bool loadBinary(GLuint p, std::string path){
+    FILE * file = fopen(path.c_str(),"rb");
+    if (file == nullptr){return false;}
+    char magic[8];
+    uint32_t format = 0, length = 0;
+    std::vector<uint8_t> data;
+    bool ok = fread(magic,1,8,file) == 8 &&
+      std::memcmp(magic,SHADER_BINARY_MAGIC,8) == 0 &&
+      fread(&format,sizeof(format),1,file) == 1 &&
+      fread(&length,sizeof(length),1,file) == 1 &&
+      length > 0;
+    if (ok){
+      data.resize(length);
+      ok = fread(data.data(),1,length,file) == length;
+    }
+    fclose(file);
+    if (!ok){return false;}
+
+    glProgramBinary(p,format,data.data(),length);
+    GLint linked = 0;
+    glGetProgramiv(p,GL_LINK_STATUS,&linked);
+    return linked == GL_TRUE;                                                     // e.g a driver update, recompile
+  }
+
+  void saveBinary(GLuint p, std::string path){
+    GLint length = 0;
+    glGetProgramiv(p,GL_PROGRAM_BINARY_LENGTH,&length);
+    if (length <= 0){return;}
+    std::vector<uint8_t> data(length);
+    GLenum format = 0;
+    glGetProgramBinary(p,length,NULL,&format,data.data());
+    if (glError("ShaderManager binary") != GL_NO_ERROR){return;}
+
+    FILE * file = fopen(path.c_str(),"wb");
+    if (file == nullptr){return;}
+    uint32_t f = format, l = length;
+    fwrite(SHADER_BINARY_MAGIC,1,8,file);
+    fwrite(&f,sizeof(f),1,file);
+    fwrite(&l,sizeof(l),1,file);
+    fwrite(data.data(),1,data.size(),file);
+    fclose(file);
+  }
+
+  std::string cacheDirectory;
+  std::string driver;
+  GLuint cameraBuffer;
+  CameraBlock camera;
+  bool binaries;
+  uint64_t cacheHits;
+  uint64_t cacheMisses;
+};
+
+// the one shared by everything drawing into the window
+inline ShaderManager & shaderManager(){
+  static ShaderManager manager;
+  return manager;
+}
+
+#endif
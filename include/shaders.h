@@ -1,7 +1,7 @@
 #ifndef SHADERS_H
 #define SHADERS_H
 
-const char * boxVertexShader = "#version 330 core\n"
+const char * const boxVertexShader = "#version 330 core\n"
   "layout(location=0) in vec2 a_position;\n"
   "uniform vec3 colour; out vec4 o_colour;\n"
   "uniform mat4 proj;\n"
@@ -11,7 +11,20 @@ const char * boxVertexShader = "#version 330 core\n"
   " gl_Position = pos;\n"
   "}";
 
-const char * boxFragmentShader = "#version 330 core\n"
+const char * const boxFragmentShader = "#version 330 core\n"
+  "in vec4 o_colour; out vec4 colour;\n"
+  "void main(){colour=o_colour;\n}";
+
+// flat coloured 2D triangles in clip space, e.g the telemetry graph
+const char * const graphVertexShader = "#version 330 core\n"
+  "layout(location=0) in vec2 a_position;\n"
+  "layout(location=1) in vec4 a_colour; out vec4 o_colour;\n"
+  "void main(){\n"
+  " o_colour = a_colour;\n"
+  " gl_Position = vec4(a_position.xy,0.0,1.0);\n"
+  "}";
+
+const char * const graphFragmentShader = "#version 330 core\n"
   "in vec4 o_colour; out vec4 colour;\n"
   "void main(){colour=o_colour;\n}";
 
@@ -20,7 +33,9 @@ const char * boxFragmentShader = "#version 330 core\n"
 // interpolation that's hard coded, it's based upon the PHASE4 colour map
 // from https://github.com/peterkovesi/PerceptualColourMaps.jl
 // which is derived from ColorCET https://colorcet.com/
-const char * particleVertexShader = "#version 330 core\n"
+// a_offset arrives as 16 bit normalised x,y in the unit box and theta/2PI
+// world space shaders share the Camera uniform block, see shaderManager.h
+const char * const particleVertexShader = "#version 330 core\n"
   "#define PI 3.14159265359\n"
   "precision highp float;\n"
   "layout(location = 0) in vec3 a_position;\n"
@@ -29,33 +44,75 @@ const char * particleVertexShader = "#version 330 core\n"
   " pow(x,3.0)*param.z+param.w,0.0,1.0);\n}"
   "vec4 cmap(float t){\n"
   " return vec4( poly(t,vec4(1.2,-8.7,7.6,0.9)), poly(t,vec4(5.6,-13.4,7.9,0.2)), poly(t,vec4(-7.9,16.0,-8.4,1.2)), 1.0 );}"
-  "uniform mat4 proj; uniform float scale; uniform float zoom;\n"
+  "layout(std140) uniform Camera { mat4 proj; float zoom; float resolution; };\n"
+  "uniform float radius;\n"
   "out vec4 o_colour;\n"
   "void main(){\n"
   " vec4 pos = proj*vec4(a_offset.xy,0.0,1.0);\n"
   " gl_Position = vec4(a_position.xy+pos.xy,0.0,1.0);\n"
-  " gl_PointSize = scale*zoom;\n"
-  " o_colour = cmap(mod(a_offset.z,2.0*PI)/(2.0*PI));\n"
+  " gl_PointSize = 2.0*radius*resolution*zoom;\n"
+  " o_colour = cmap(a_offset.z);\n"
   "}";
-const char * particleFragmentShader = "#version 330 core\n"
+const char * const particleFragmentShader = "#version 330 core\n"
   "in vec4 o_colour; out vec4 colour;\n"
+  "uniform float opacity;\n"
   "void main(){\n"
   " vec2 c = 2.0*gl_PointCoord-1.0;\n"
   " float d = length(c);\n"
   // bit of simple AA
   " float alpha = 1.0-smoothstep(0.99,1.01,d);\n"
-  " colour = vec4(o_colour.rgb,alpha);\n"
+  " colour = vec4(o_colour.rgb,alpha*opacity);\n"
+  " if (colour.a == 0.0){discard;}"
+  "}";
+
+// zoomed out level of detail, one quad over the box textured with
+// per cell r = area fraction covered, g,b = mean cos,sin theta mapped
+// to [0,1]. Coloured by mean orientation with the particles' colour
+// map, greyed out where the cell is disordered
+const char * const densityVertexShader = "#version 330 core\n"
+  "layout(location = 0) in vec2 a_position;\n"
+  "layout(std140) uniform Camera { mat4 proj; float zoom; float resolution; };\n"
+  "uniform vec2 extent;\n"
+  "out vec2 o_texCoords;\n"
+  "void main(){\n"
+  " o_texCoords = a_position;\n"
+  " gl_Position = proj*vec4(a_position*extent,0.0,1.0);\n"
+  "}";
+const char * const densityFragmentShader = "#version 330 core\n"
+  "#define PI 3.14159265359\n"
+  "precision highp float;\n"
+  "float poly(float x, vec4 param){return clamp(x*param.x+pow(x,2.0)*param.y+"
+  " pow(x,3.0)*param.z+param.w,0.0,1.0);\n}"
+  "vec4 cmap(float t){\n"
+  " return vec4( poly(t,vec4(1.2,-8.7,7.6,0.9)), poly(t,vec4(5.6,-13.4,7.9,0.2)), poly(t,vec4(-7.9,16.0,-8.4,1.2)), 1.0 );}"
+  "uniform sampler2D density; uniform float opacity;\n"
+  "in vec2 o_texCoords; out vec4 colour;\n"
+  "void main(){\n"
+  " vec4 d = texture(density,o_texCoords);\n"
+  " vec2 m = 2.0*d.gb-1.0;\n"
+  " float t = atan(m.y,m.x)/(2.0*PI);\n"
+  " vec3 c = mix(vec3(0.5),cmap(t-floor(t)).rgb,clamp(length(m),0.0,1.0));\n"
+  " colour = vec4(c,d.r*opacity);\n"
+  " if (colour.a == 0.0){discard;}"
+  "}";
+
+// a per cell load texture over the box, drawn with densityVertexShader
+const char * const heatmapFragmentShader = "#version 330 core\n"
+  "uniform sampler2D load;\n"
+  "in vec2 o_texCoords; out vec4 colour;\n"
+  "void main(){\n"
+  " colour = texture(load,o_texCoords);\n"
   " if (colour.a == 0.0){discard;}"
   "}";
 
-const char * atrepVertexShader = "#version 330 core\n"
+const char * const atrepVertexShader = "#version 330 core\n"
   "precision highp float; precision highp int;\n"
   "layout(location = 0) in vec3 a_position;\n"
   "layout(location = 1) in float a_offset;\n"
   "out vec4 o_colour; out float o_time;\n"
   "uniform int na; uniform int nr; uniform mat4 attr; uniform mat4 rep;\n"
-  "uniform float maxNANR;\n"
-  "uniform float scale; uniform mat4 proj; uniform float zoom;\n"
+  "layout(std140) uniform Camera { mat4 proj; float zoom; float resolution; };\n"
+  "uniform float radius;\n"
   "uniform float t; uniform float T;\n"
   "void main(void){\n"
   "   int a = int(floor(a_offset)); float x = 0.0; float y = 0.0; float drawa = 0.0; float drawr = 0.0;\n"
@@ -68,10 +125,10 @@ const char * atrepVertexShader = "#version 330 core\n"
   "   o_colour = vec4(1.0,1.0,1.0,0.0); float time = 1.0;\n"
   "   if (drawr > 0.0 ){ o_colour = vec4(1.0,0.0,0.0,1.0); time = t/T;}"
   "   else if (drawa > 0.0){ o_colour = vec4(0.0,1.0,0.0,1.0); time = 1.0-t/T;}\n"
-  "   gl_PointSize = scale*zoom*time;\n"
+  "   gl_PointSize = 16.0*radius*resolution*zoom*time;\n"
   "}";
 
-const char * atRepfragmentShader= "#version 330 core\n"
+const char * const atRepfragmentShader = "#version 330 core\n"
   "in vec4 o_colour; out vec4 colour;\n"
   "void main(){\n"
   " if (o_colour.a == 0.0){discard;}"
@@ -0,0 +1,130 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <cstdint>
+
+/*
+  A GL_ARRAY_BUFFER for data rewritten every frame.
+
+  With ARB_buffer_storage the buffer holds a ring of regions
+  persistently mapped once, writers fill the next region in place
+  and a fence per region keeps them off memory the GPU has not
+  finished reading. Otherwise the whole buffer is orphaned and
+  remapped each frame so the driver can hand back fresh memory
+  instead of synchronising with draws still in flight.
+
+  usage per frame:
+    void * p = buffer.map();  // fill regionBytes at p
+    uint64_t o = buffer.unmap();
+    // ... draw sourcing from byte offset o ...
+    buffer.fence();
+*/
+class StreamBuffer {
+public:
+
+  StreamBuffer()
+  : buffer(0), regionBytes(0), regions(0), current(0), persistent(false), base(nullptr) {}
+
+  void initialise(uint64_t bytes, uint8_t nRegions = 3){
+    regionBytes = (bytes+255) & ~uint64_t(255);                                  // keep every region's offset aligned
+    persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    regions = persistent ? std::min(nRegions,uint8_t(4)) : 1;
+
+    glGenBuffers(1,&buffer);
+    glBindBuffer(GL_ARRAY_BUFFER,buffer);
+    if (persistent){
+      GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_ARRAY_BUFFER,regionBytes*regions,NULL,flags);
+      base = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER,0,regionBytes*regions,flags);
+      if (base == nullptr){
+        // storage is immutable, fall back on a fresh buffer
+        glBindBuffer(GL_ARRAY_BUFFER,0);
+        glDeleteBuffers(1,&buffer);
+        glGenBuffers(1,&buffer);
+        glBindBuffer(GL_ARRAY_BUFFER,buffer);
+        persistent = false;
+        regions = 1;
+      }
+    }
+    if (!persistent){
+      glBufferData(GL_ARRAY_BUFFER,regionBytes,NULL,GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+    for (uint8_t r = 0; r < 4; r++){fences[r] = 0;}
+    glError("StreamBuffer initialise");
+  }
+
+  ~StreamBuffer(){
+    if (buffer == 0){return;}
+    for (uint8_t r = 0; r < 4; r++){
+      if (fences[r] != 0){glDeleteSync(fences[r]);}
+    }
+    if (persistent){
+      glBindBuffer(GL_ARRAY_BUFFER,buffer);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glBindBuffer(GL_ARRAY_BUFFER,0);
+    }
+    glDeleteBuffers(1,&buffer);
+  }
+
+  GLuint id(){return buffer;}
+  bool isPersistent(){return persistent;}
+  uint64_t size(){return regionBytes;}
+  uint64_t bytes(){return regionBytes*regions;}
+
+  // pointer to regionBytes of writable memory for the next frame, nullptr
+  // if the driver could not map it (skip the frame, no unmap())
+  void * map(){
+    if (persistent){
+      current = (current+1) % regions;
+      if (fences[current] != 0){
+        // only blocks when the GPU is a whole ring behind
+        while (glClientWaitSync(fences[current],GL_SYNC_FLUSH_COMMANDS_BIT,1000000) == GL_TIMEOUT_EXPIRED){}
+        glDeleteSync(fences[current]);
+        fences[current] = 0;
+      }
+      return base+current*regionBytes;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER,buffer);
+    glBufferData(GL_ARRAY_BUFFER,regionBytes,NULL,GL_STREAM_DRAW);                // orphan
+    void * p = glMapBufferRange(
+      GL_ARRAY_BUFFER,
+      0,
+      regionBytes,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+    );
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+    if (p == nullptr){glError("StreamBuffer map");}
+    return p;
+  }
+
+  // done writing, the byte offset of the region to source from
+  uint64_t unmap(){
+    if (persistent){
+      return current*regionBytes;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER,buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+    return 0;
+  }
+
+  // call after the last draw reading the current region, again if it is redrawn
+  void fence(){
+    if (persistent){
+      if (fences[current] != 0){glDeleteSync(fences[current]);}
+      fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+    }
+  }
+
+private:
+  GLuint buffer;
+  uint64_t regionBytes;
+  uint8_t regions;
+  uint8_t current;
+  bool persistent;
+  uint8_t * base;
+  GLsync fences[4];
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+// seconds on a monotonic clock shared by the physics and render threads
+inline double wallClock(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+enum class Metric : uint8_t {
+  FRAME,                                                                          // whole frame including the swap
+  WORK,                                                                           // frame up to the swap
+  PHYSICS,                                                                        // one simulation step
+  RENDER,                                                                         // render thread's part of a frame
+  UPLOAD,                                                                         // writing instances or the density field
+  IO,                                                                             // one trajectory frame or capture written
+  GPU,                                                                            // GPU time of every timed pass in a frame
+  GPU_PARTICLES,
+  GPU_TOYS,
+  GPU_BOX,
+  GPU_TEXT,
+  COUNT
+};
+
+inline const char * metricName(Metric m){
+  switch (m){
+    case Metric::FRAME: return "frame";
+    case Metric::WORK: return "work";
+    case Metric::PHYSICS: return "physics";
+    case Metric::RENDER: return "render";
+    case Metric::UPLOAD: return "upload";
+    case Metric::IO: return "io";
+    case Metric::GPU: return "gpu";
+    case Metric::GPU_PARTICLES: return "gpu_particles";
+    case Metric::GPU_TOYS: return "gpu_toys";
+    case Metric::GPU_BOX: return "gpu_box";
+    case Metric::GPU_TEXT: return "gpu_text";
+    default: return "unknown";
+  }
+}
+
+struct MetricSummary {
+  uint64_t n = 0;
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p95 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+/*
+  Timings in seconds for each Metric, kept in fixed rings of the last
+  capacity samples.
+
+  Any thread records with one fetch_add to claim a slot and a store,
+  nothing ever locks or allocates, so the physics thread, capture
+  workers and the render loop all write freely. Readers copy out the
+  newest window of samples; a slot being rewritten mid copy just reads
+  as its old or new value, fine for statistics.
+*/
+class Telemetry {
+public:
+
+  static const uint64_t capacity = 1024;                                          // samples kept per metric, a power of 2
+
+  Telemetry(uint64_t window = 120)
+  : defaultWindow(window)
+  {
+    for (uint8_t m = 0; m < uint8_t(Metric::COUNT); m++){
+      heads[m] = 0;
+      totals[m] = 0;
+      for (uint64_t i = 0; i < capacity; i++){samples[m][i] = 0.0;}
+    }
+  }
+
+  void record(Metric m, double seconds){
+    uint64_t i = heads[uint8_t(m)].fetch_add(1,std::memory_order_relaxed);
+    samples[uint8_t(m)][i & (capacity-1)].store(seconds,std::memory_order_relaxed);
+    totals[uint8_t(m)].fetch_add(uint64_t(std::max(0.0,seconds)*1e9+0.5),std::memory_order_relaxed);
+  }
+
+  // samples ever recorded
+  uint64_t count(Metric m){return heads[uint8_t(m)].load(std::memory_order_relaxed);}
+  // seconds ever recorded, like count() it only grows
+  double total(Metric m){return totals[uint8_t(m)].load(std::memory_order_relaxed)*1e-9;}
+
+  // copy up to window of the newest samples into out, oldest first
+  uint64_t recent(Metric m, double * out, uint64_t window = 0){
+    if (window == 0){window = defaultWindow;}
+    uint64_t head = count(m);
+    uint64_t n = std::min(std::min(window,capacity),head);
+    for (uint64_t k = 0; k < n; k++){
+      out[k] = samples[uint8_t(m)][(head-n+k) & (capacity-1)].load(std::memory_order_relaxed);
+    }
+    return n;
+  }
+
+  // statistics over up to window of the newest samples (0 for the default window)
+  MetricSummary summary(Metric m, uint64_t window = 0){
+    double buffer[capacity];
+    MetricSummary s;
+    s.n = recent(m,buffer,window);
+    if (s.n == 0){return s;}
+    // one sort serves every percentile
+    std::sort(buffer,buffer+s.n);
+    for (uint64_t k = 0; k < s.n; k++){s.mean += buffer[k];}
+    s.mean /= s.n;
+    s.p50 = nearestRank(buffer,s.n,0.50);
+    s.p95 = nearestRank(buffer,s.n,0.95);
+    s.p99 = nearestRank(buffer,s.n,0.99);
+    s.max = buffer[s.n-1];
+    return s;
+  }
+
+  void setWindow(uint64_t window){defaultWindow = std::max(uint64_t(1),std::min(window,capacity));}
+  uint64_t window(){return defaultWindow;}
+
+private:
+
+  double nearestRank(const double * sorted, uint64_t n, double p){
+    uint64_t rank = uint64_t(std::ceil(p*n));
+    return sorted[rank == 0 ? 0 : std::min(n,rank)-1];
+  }
+
+  std::atomic<uint64_t> heads[uint8_t(Metric::COUNT)];
+  std::atomic<uint64_t> totals[uint8_t(Metric::COUNT)];                           // nanoseconds, integer so fetch_add works
+  std::atomic<double> samples[uint8_t(Metric::COUNT)][capacity];
+  uint64_t defaultWindow;
+};
+
+// the process wide telemetry every subsystem records into
+inline Telemetry & telemetry(){
+  static Telemetry t;
+  return t;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef TELEMETRYGRAPH_H
+#define TELEMETRYGRAPH_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <shaders.h>
+#include <shaderManager.h>
+
+/*
+  A small histogram of frame times for the overlay, drawn as one batch
+  of flat triangles over whatever is on screen.
+
+  Bins span 0 to 4x the target frame time, the last also catching
+  anything slower. Bar heights go with the square root of the count
+  so a handful of stutters in the tail still shows next to the peak,
+  and bars are green up to the target, amber to twice it, then red.
+  A dark tick marks the target itself.
+*/
+class FrameTimeGraph {
+public:
+
+  static const uint32_t bins = 32;
+
+  // x,y lower left corner, w x h in pixels of a resX x resY window
+  FrameTimeGraph(float x, float y, float w, float h, float resX, float resY)
+  : vao(0), vbo(0)
+  {
+    // to clip space once, the window never resizes
+    x0 = 2.0f*x/resX-1.0f;
+    y0 = 2.0f*y/resY-1.0f;
+    width = 2.0f*w/resX;
+    height = 2.0f*h/resY;
+
+    shader = shaderManager().program(graphVertexShader,graphFragmentShader);
+
+    glGenVertexArrays(1,&vao);
+    glGenBuffers(1,&vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER,vbo);
+    glBufferData(GL_ARRAY_BUFFER,sizeof(float)*vertexFloats*6*(bins+2),NULL,GL_DYNAMIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0,2,GL_FLOAT,GL_FALSE,vertexFloats*sizeof(float),0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1,4,GL_FLOAT,GL_FALSE,vertexFloats*sizeof(float),(void*)(2*sizeof(float)));
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+    glBindVertexArray(0);
+    glError("FrameTimeGraph");
+  }
+
+  ~FrameTimeGraph(){
+    glDeleteBuffers(1,&vbo);
+    glDeleteVertexArrays(1,&vao);
+  }
+
+  FrameTimeGraph(const FrameTimeGraph &) = delete;
+  FrameTimeGraph & operator=(const FrameTimeGraph &) = delete;
+
+  void draw(const double * samples, uint64_t n, double target){
+    uint64_t counts[bins] = {0};
+    double binWidth = 4.0*target/bins;
+    for (uint64_t i = 0; i < n; i++){
+      uint64_t b = uint64_t(std::max(0.0,samples[i])/binWidth);
+      counts[std::min(b,uint64_t(bins-1))]++;
+    }
+    uint64_t peak = std::max(uint64_t(1),*std::max_element(counts,counts+bins));
+
+    vertices.clear();
+    quad(0.0f,0.0f,1.0f,1.0f,0.0f,0.0f,0.0f,0.15f);
+    float barWidth = 1.0f/bins;
+    for (uint32_t b = 0; b < bins; b++){
+      if (counts[b] == 0){continue;}
+      float h = float(std::sqrt(double(counts[b])/peak));
+      double t = (b+0.5)*binWidth;
+      if (t <= target*1.05){
+        quad(b*barWidth,0.0f,barWidth*0.9f,h,0.2f,0.7f,0.2f,0.9f);
+      }
+      else if (t <= target*2.0){
+        quad(b*barWidth,0.0f,barWidth*0.9f,h,0.9f,0.6f,0.1f,0.9f);
+      }
+      else{
+        quad(b*barWidth,0.0f,barWidth*0.9f,h,0.9f,0.1f,0.1f,0.9f);
+      }
+    }
+    quad(0.25f,0.0f,0.005f,1.0f,0.0f,0.0f,0.0f,0.8f);                             // target is a quarter of the range
+
+    glUseProgram(shader);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER,vbo);
+    glBufferSubData(GL_ARRAY_BUFFER,0,sizeof(float)*vertices.size(),vertices.data());
+    glDrawArrays(GL_TRIANGLES,0,vertices.size()/vertexFloats);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+    glBindVertexArray(0);
+  }
+
+private:
+
+  static const uint32_t vertexFloats = 6;                                         // x,y,r,g,b,a
+
+  // a rectangle in graph units, [0,1] both ways
+  void quad(float x, float y, float w, float h, float r, float g, float b, float a){
+    float cx[6] = {x,x+w,x+w,x,x,x+w};
+    float cy[6] = {y,y,y+h,y,y+h,y+h};
+    for (uint8_t v = 0; v < 6; v++){
+      vertices.push_back(x0+cx[v]*width);
+      vertices.push_back(y0+cy[v]*height);
+      vertices.push_back(r);
+      vertices.push_back(g);
+      vertices.push_back(b);
+      vertices.push_back(a);
+    }
+  }
+
+  float x0, y0, width, height;
+  GLuint shader, vao, vbo;
+  std::vector<float> vertices;
+};
+
+#endif
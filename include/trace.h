@@ -0,0 +1,175 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <algorithm>
+
+#include <telemetry.h>
+
+struct TraceEvent {
+  const char * name;                                                              // a literal, never copied
+  double start;
+  double duration;
+};
+
+/*
+  One thread's events, a ring of the newest capacity. Only the owning
+  thread writes; a dump from elsewhere reads up to the published count
+  and skips the oldest part of the ring the owner could be rewriting.
+*/
+struct TraceBuffer {
+
+  static const uint64_t capacity = 1 << 16;                                       // a power of 2
+
+  TraceBuffer(uint32_t tid, std::string name)
+  : events(capacity), count(0), tid(tid), name(name) {}
+
+  void push(const char * event, double start, double duration){
+    uint64_t i = count.load(std::memory_order_relaxed);
+    events[i & (capacity-1)] = {event,start,duration};
+    count.store(i+1,std::memory_order_release);
+  }
+
+  std::vector<TraceEvent> events;
+  std::atomic<uint64_t> count;
+  uint64_t dumped = 0;                                                            // count at the last dump, under the tracer's lock
+  uint32_t tid;
+  std::string name;
+};
+
+/*
+  Scoped timing markers for a Chrome trace (chrome://tracing, Perfetto).
+
+  Every thread records into its own buffer, registered on its first
+  event, so recording never takes a lock. While tracing is off a
+  marker costs one relaxed atomic load. dump() writes every thread's
+  events since the previous dump as "complete" events of a Chrome
+  trace JSON file, so each T...T session gets only its own.
+*/
+class Tracer {
+public:
+
+  Tracer()
+  : enabled(false), origin(wallClock()) {}
+
+  // with an output path set, a trace still running at exit is dumped there
+  ~Tracer(){
+    if (enabled && output != ""){dump(output);}
+  }
+
+  void setEnabled(bool e){enabled.store(e,std::memory_order_relaxed);}
+  bool isEnabled(){return enabled.load(std::memory_order_relaxed);}
+
+  void setOutput(std::string path){output = path;}
+  std::string getOutput(){return output;}
+
+  // label the calling thread in the trace
+  void nameThread(std::string name){
+    std::lock_guard<std::mutex> lock(mutex);
+    local(false)->name = name;
+  }
+
+  void record(const char * name, double start, double end){
+    local(true)->push(name,start,end-start);
+  }
+
+  bool dump(std::string path){
+    FILE * file = fopen(path.c_str(),"w");
+    if (file == nullptr){
+      std::cout << "Could not open " << path << " for writing a trace\n";
+      return false;
+    }
+    uint64_t written = 0;
+    fprintf(file,"{\"traceEvents\":[\n");
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint64_t b = 0; b < buffers.size(); b++){
+      TraceBuffer & t = *buffers[b];
+      fprintf(file,"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+        b == 0 ? "" : ",\n",t.tid,t.name.c_str());
+      uint64_t end = t.count.load(std::memory_order_acquire);
+      // leave an eighth of the ring as slack for the owner still writing
+      uint64_t keep = TraceBuffer::capacity-TraceBuffer::capacity/8;
+      // and each dump only the events since the one before
+      uint64_t begin = std::max(end > keep ? end-keep : 0,t.dumped);
+      t.dumped = end;
+      for (uint64_t i = begin; i < end; i++){
+        const TraceEvent & e = t.events[i & (TraceBuffer::capacity-1)];
+        // microseconds, the unit the format expects
+        fprintf(file,",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+          e.name,t.tid,(e.start-origin)*1e6,e.duration*1e6);
+      }
+      written += end-begin;
+    }
+    fprintf(file,"\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    std::cout << "Wrote " << written << " trace events to " << path << "\n";
+    return true;
+  }
+
+private:
+
+  TraceBuffer * local(bool needsLock){
+    thread_local TraceBuffer * buffer = nullptr;
+    if (buffer == nullptr){
+      std::unique_lock<std::mutex> lock(mutex,std::defer_lock);
+      if (needsLock){lock.lock();}                                                // nameThread() already holds it
+      uint32_t tid = uint32_t(buffers.size()+1);
+      buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer(tid,"thread "+std::to_string(tid))));
+      buffer = buffers.back().get();
+    }
+    return buffer;
+  }
+
+  std::atomic<bool> enabled;
+  double origin;
+  std::string output;
+  std::mutex mutex;
+  std::vector<std::unique_ptr<TraceBuffer>> buffers;
+};
+
+inline Tracer & tracer(){
+  static Tracer t;
+  return t;
+}
+
+/*
+  Times its own lifetime as one event when tracing is on, next() ends
+  the current phase and starts another under the same marker, e.g
+
+    TraceScope trace("step/cells");
+    // ...
+    trace.next("step/collisions");
+*/
+class TraceScope {
+public:
+
+  TraceScope(const char * name)
+  : name(name), start(tracer().isEnabled() ? wallClock() : -1.0) {}
+
+  ~TraceScope(){end();}
+
+  void next(const char * phase){
+    end();
+    name = phase;
+    start = tracer().isEnabled() ? wallClock() : -1.0;
+  }
+
+  void end(){
+    if (start < 0.0){return;}
+    tracer().record(name,start,wallClock());
+    start = -1.0;
+  }
+
+private:
+  const char * name;
+  double start;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+  Lock free single producer, single consumer triple buffer.
+
+  The writer fills back() and publish()es it, the reader calls
+  update() and then reads front(). Neither side ever waits, the
+  reader just sees the newest completed value. The shared middle
+  slot index and a "fresh" bit live in one atomic byte.
+*/
+template <class T>
+class TripleBuffer {
+public:
+
+  TripleBuffer()
+  : backIndex(0), middle(1), frontIndex(2) {}
+
+  T & back(){return buffers[backIndex];}
+  T & front(){return buffers[frontIndex];}
+
+  // writer: hand back() over, start writing into the old middle slot
+  void publish(){
+    uint8_t old = middle.exchange(backIndex | FRESH,std::memory_order_acq_rel);
+    backIndex = old & INDEX;
+  }
+
+  // reader: take the newest published value if there is one
+  bool update(){
+    if ((middle.load(std::memory_order_relaxed) & FRESH) == 0){
+      return false;
+    }
+    uint8_t old = middle.exchange(frontIndex,std::memory_order_acq_rel);
+    frontIndex = old & INDEX;
+    return true;
+  }
+
+  // reader: is there something newer than front()
+  bool fresh(){return (middle.load(std::memory_order_relaxed) & FRESH) != 0;}
+
+private:
+
+  static const uint8_t INDEX = 0x3;
+  static const uint8_t FRESH = 0x4;
+
+  T buffers[3];
+  uint8_t backIndex;
+  std::atomic<uint8_t> middle;
+  uint8_t frontIndex;
+};
+
+#endif
@@ -14,35 +14,375 @@
 #include <glUtils.h>
 #include <utils.h>
 #include <shaders.h>
-
-#include <ParticleSystem/particleSystem.cpp>
+#include <shaderManager.h>
+#include <renderTarget.h>
+#include <resolutionController.h>
+#include <telemetry.h>
+#include <telemetryGraph.h>
+#include <trace.h>
+#include <perfCounters.h>
+#include <memoryStats.h>
+#include <gpuTimer.h>
+
+#include <ParticleSystem/particleSystem.h>
+#include <ParticleSystem/physicsThread.cpp>
 #include <Text/textRenderer.cpp>
+#include <Trajectory/trajectory.cpp>
+#include <Configuration/configuration.cpp>
+#include <Capture/capture.cpp>
+#include <Splat/splatRenderer.cpp>
+#include <StatsServer/statsServer.cpp>
 
 #include <time.h>
 #include <random>
 #include <iostream>
 #include <math.h>
 #include <vector>
+#include <memory>
+#include <string>
+#include <cstdlib>
 
 const int resX = 720;
 const int resY = 720;
 
+// fixed simulation steps per 60th of a second of wall time
 const int subSample = 1;
+const double targetFrameTime = 1.0/60.0;
+// while paused, frames still rendered after the last change before sleeping
+// on events, covers toy edits the physics thread has yet to publish
+const uint8_t settleFrames = 8;
 const int N = 100000;
 // motion parameters
 
 const int maxAttractors = 8;
 const int maxRepellors = 8;
 
-// for smoothing delta numbers
-uint8_t frameId = 0;
-double deltas[60];
-double physDeltas[60];
-double renderDeltas[60];
+// trajectory playback speed limits, in recorded frames per rendered frame
+const double minPlaybackSpeed = 1.0/16.0;
+const double maxPlaybackSpeed = 64.0;
+
+void printUsage(){
+  std::cout << "Usage: Jerboa [options]\n"
+    << "  -record <file>       record a trajectory while simulating\n"
+    << "  -recordEvery <n>     steps between recorded frames (default 1)\n"
+    << "  -play <file>         play back a recorded trajectory, no physics\n"
+    << "  -init <file>         initial configuration (trajectory, .bin/.raw float32 x,y,theta or CSV)\n"
+    << "  -density <d>         packing fraction, sets the particle radius (default 0.5)\n"
+    << "  -unlimited           step physics as fast as possible instead of in wall time\n"
+    << "  -capture <pattern>   capture frames to a PNG sequence, e.g frames/%06d.png,\n"
+    << "                       or - for raw rgb24 on stdout\n"
+    << "  -captureWorkers <n>  threads writing PNGs (default cores-1)\n"
+    << "  -telemetryWindow <n> samples the overlay's percentiles cover (default 120)\n"
+    << "  -trace <file>        record a Chrome trace from the start, written on exit or T\n"
+    << "  -particles <n>       randomly placed particles (default 100000)\n"
+    << "  -counters            hardware counters (cycles, instructions, misses) per step phase\n"
+    << "  -benchmark <steps>   step flat out with no window, print timings and counters as JSON\n"
+    << "  -memory              print memory used per array, RSS and bytes per particle\n"
+    << "  -statsSocket <path>  serve live stats as JSON or Prometheus text on a Unix socket\n"
+    << "  -shm <name>          publish positions to a POSIX shared memory ring for other processes\n"
+    << "  -shmEvery <n>        steps between shared frames (default 1)\n"
+    << "  -headless            no window or GPU, simulate (or play back) and write snapshots\n"
+    << "  -steps <n>           steps to run headless (default 10000)\n"
+    << "  -snapshot <pattern>  headless PNG snapshots, e.g snapshots/%06d.png\n"
+    << "  -snapshotEvery <n>   steps (or played frames) between snapshots (default 1000)\n"
+    << "  -snapshotSize <w> <h> snapshot resolution (default 3840 2160)\n";
+}
+
+// per step phase times (and IPC when counted) between two stats snapshots
+std::string phaseSummary(const SimulationStats & now, const SimulationStats & then){
+  std::string ms = "Phases ms: ", ipc = "IPC: ";
+  for (uint8_t p = 0; p < STEP_PHASES; p++){
+    const PhaseStats & a = now.phases[p];
+    const PhaseStats & b = then.phases[p];
+    uint64_t calls = a.calls-b.calls;
+    std::string sep = p == 0 ? "" : "/";
+    ms += sep+fixedLengthNumber(calls > 0 ? 1000.0*(a.seconds-b.seconds)/calls : 0.0,5);
+    PerfSample d = a.counters-b.counters;
+    ipc += sep+fixedLengthNumber(d.counts[CYCLES] > 0 ? double(d.counts[INSTRUCTIONS])/d.counts[CYCLES] : 0.0,4);
+  }
+  ms += " (cells/collisions/integrate)\n";
+  return now.counters() ? ms+ipc+"\n" : ms;
+}
+
+// steps flat out on this thread, the JSON goes to out
+int runBenchmark(ParticleSystem & particles, uint64_t steps, std::ostream & out){
+  double tic = wallClock();
+  for (uint64_t s = 0; s < steps; s++){
+    particles.step();
+  }
+  double seconds = wallClock()-tic;
+
+  out << "{\"particles\":" << particles.size()
+    << ",\"density\":" << particles.getDensity()
+    << ",\"steps\":" << steps
+    << ",\"seconds\":" << seconds
+    << ",\"steps_per_second\":" << (seconds > 0.0 ? steps/seconds : 0.0)
+    << ",\"stats\":";
+  writeStatsJSON(out,particles.getStats());
+  out << ",\"memory\":";
+  writeMemoryJSON(out,particles.memory());
+  out << "}\n";
+  return 0;
+}
+
+// steps physics (or reads back a trajectory) on this thread, splatting
+// snapshots on the CPU, for batch machines with no display or GPU
+int runHeadless(
+  ParticleSystem & particles,
+  TrajectoryReader * trajectory,
+  TrajectoryWriter * recorder,
+  uint32_t recordEvery,
+  uint64_t steps,
+  std::string snapshotPattern,
+  uint64_t snapshotEvery,
+  uint32_t width,
+  uint32_t height,
+  bool memory
+){
+  std::unique_ptr<SplatRenderer> splat;
+  if (snapshotPattern != ""){
+    splat.reset(new SplatRenderer(width,height));
+  }
+  float radius = trajectory ? trajectory->getHeader().radius : particles.getRadius();
+
+  uint64_t written = 0;
+  double splatTime = 0.0;
+  auto snapshot = [&](const float * state, uint64_t n, uint64_t id){
+    double tic = wallClock();
+    splat->render(state,n,radius);
+    splatTime += wallClock()-tic;
+    char path[4096];
+    snprintf(path,sizeof(path),snapshotPattern.c_str(),int(id));
+    if (splat->write(path)){written++;}
+  };
+
+  double tic = wallClock();
+  if (trajectory){
+    if (!splat){
+      std::cout << "Nothing to do, playing back headless needs -snapshot\n";
+      return 1;
+    }
+    for (uint64_t f = 0; f < trajectory->nFrames(); f += snapshotEvery){
+      trajectory->prefetch(f+snapshotEvery);
+      snapshot(trajectory->frame(f),trajectory->nParticles(),f);
+    }
+  }
+  else{
+    for (uint64_t s = 1; s <= steps; s++){
+      double stepTic = wallClock();
+      particles.step();
+      telemetry().record(Metric::PHYSICS,wallClock()-stepTic);
+      if (recorder && particles.getSteps() % recordEvery == 0){
+        recorder->write(particles.getState());
+      }
+      if (splat && s % snapshotEvery == 0){
+        snapshot(particles.getState(),particles.size(),s);
+      }
+    }
+  }
+
+  std::cout << "Headless run took " << wallClock()-tic << " s";
+  if (splat){
+    std::cout << ", " << written << " snapshots at " << width << "x" << height
+      << " averaging " << (written > 0 ? splatTime/written : 0.0) << " s to splat";
+  }
+  std::cout << "\n";
+  MetricSummary step = telemetry().summary(Metric::PHYSICS,Telemetry::capacity);
+  std::cout << "Step p50/p95/p99/max (last " << step.n << "): "
+    << step.p50 << "/" << step.p95 << "/" << step.p99 << "/" << step.max << " s\n";
+  if (memory){printMemoryReport(std::cout,particles.memory());}
+  return 0;
+}
+
+int main(int argc, char ** argv){
+
+  tracer().nameThread("main");
+  std::string playPath = "";
+  std::string recordPath = "";
+  uint32_t recordEvery = 1;
+  std::string initPath = "";
+  float density = 0.5;
+  bool unlimited = false;
+  std::string capturePattern = "";
+  unsigned captureWorkers = 0;
+  bool headless = false;
+  uint64_t headlessSteps = 10000;
+  std::string snapshotPattern = "";
+  uint64_t snapshotEvery = 1000;
+  uint32_t snapshotWidth = 3840;
+  uint32_t snapshotHeight = 2160;
+  uint64_t nRandom = N;
+  bool counters = false;
+  uint64_t benchmarkSteps = 0;
+  bool memoryReport = false;
+  std::string statsSocket = "";
+  std::string shmName = "";
+  uint64_t shmEvery = 1;
+
+  for (int i = 1; i < argc; i++){
+    std::string arg = argv[i];
+    if (arg == "-play" && i+1 < argc){
+      playPath = argv[++i];
+    }
+    else if (arg == "-record" && i+1 < argc){
+      recordPath = argv[++i];
+    }
+    else if (arg == "-recordEvery" && i+1 < argc){
+      recordEvery = std::max(1,std::atoi(argv[++i]));
+    }
+    else if (arg == "-init" && i+1 < argc){
+      initPath = argv[++i];
+    }
+    else if (arg == "-density" && i+1 < argc){
+      density = std::atof(argv[++i]);
+      if (!std::isfinite(density) || density <= 0.0){
+        std::cout << "-density must be a packing fraction > 0, got " << argv[i] << "\n";
+        return 1;
+      }
+    }
+    else if (arg == "-unlimited"){
+      unlimited = true;
+    }
+    else if (arg == "-capture" && i+1 < argc){
+      capturePattern = argv[++i];
+      if (capturePattern != "-" && !framePattern(capturePattern)){
+        std::cout << "-capture needs one frame number conversion, e.g frames/%06d.png, got " << capturePattern << "\n";
+        return 1;
+      }
+    }
+    else if (arg == "-captureWorkers" && i+1 < argc){
+      captureWorkers = std::max(1,std::atoi(argv[++i]));
+    }
+    else if (arg == "-telemetryWindow" && i+1 < argc){
+      telemetry().setWindow(std::max(1,std::atoi(argv[++i])));
+    }
+    else if (arg == "-trace" && i+1 < argc){
+      tracer().setOutput(argv[++i]);
+      tracer().setEnabled(true);
+    }
+    else if (arg == "-particles" && i+1 < argc){
+      nRandom = std::max(1ull,std::strtoull(argv[++i],nullptr,10));
+    }
+    else if (arg == "-counters"){
+      counters = true;
+    }
+    else if (arg == "-benchmark" && i+1 < argc){
+      benchmarkSteps = std::max(1ull,std::strtoull(argv[++i],nullptr,10));
+    }
+    else if (arg == "-memory"){
+      memoryReport = true;
+    }
+    else if (arg == "-statsSocket" && i+1 < argc){
+      statsSocket = argv[++i];
+    }
+    else if (arg == "-shm" && i+1 < argc){
+      shmName = argv[++i];
+    }
+    else if (arg == "-shmEvery" && i+1 < argc){
+      shmEvery = std::max(1ull,std::strtoull(argv[++i],nullptr,10));
+    }
+    else if (arg == "-headless"){
+      headless = true;
+    }
+    else if (arg == "-steps" && i+1 < argc){
+      headlessSteps = std::strtoull(argv[++i],nullptr,10);
+    }
+    else if (arg == "-snapshot" && i+1 < argc){
+      snapshotPattern = argv[++i];
+      if (!framePattern(snapshotPattern)){
+        std::cout << "-snapshot needs one snapshot number conversion, e.g snapshots/%06d.png, got " << snapshotPattern << "\n";
+        return 1;
+      }
+    }
+    else if (arg == "-snapshotEvery" && i+1 < argc){
+      snapshotEvery = std::max(1,std::atoi(argv[++i]));
+    }
+    else if (arg == "-snapshotSize" && i+2 < argc){
+      snapshotWidth = std::max(1,std::atoi(argv[++i]));
+      snapshotHeight = std::max(1,std::atoi(argv[++i]));
+    }
+    else{
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (capturePattern == "-"){
+    // stdout carries the frames, everything else goes to stderr
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
 
-int main(){
+  std::unique_ptr<TrajectoryReader> trajectory;
+  if (playPath != ""){
+    trajectory.reset(new TrajectoryReader(playPath));
+    if (!trajectory->isOpen()){
+      return 1;
+    }
+  }
 
-  for (int i = 0; i < 60; i++){deltas[i] = 0.0;}
+  std::vector<float> initial;
+  if (initPath != "" && !trajectory){
+    sf::Clock loadClock;
+    if (!loadConfiguration(initPath,initial)){
+      return 1;
+    }
+    std::cout << "Loaded " << initial.size()/3 << " particles from " << initPath
+      << " in " << loadClock.getElapsedTime().asSeconds() << " s\n";
+  }
+
+  uint64_t nParticles = trajectory ? trajectory->nParticles() : (initial.size() > 0 ? initial.size()/3 : nRandom);
+  float dt = trajectory ? trajectory->getHeader().dt : 1.0/120.0;
+  if (trajectory){density = trajectory->getHeader().density;}
+
+  if (benchmarkSteps > 0 && !trajectory){
+    // stdout is only the JSON, everything else goes to stderr
+    std::ostream json(std::cout.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+    ParticleSystem particles(nParticles,initial.size() > 0 ? &initial[0] : nullptr,dt,density);
+    std::vector<float>().swap(initial);
+    particles.enableCounters(true);
+    return runBenchmark(particles,benchmarkSteps,json);
+  }
+
+  if (headless){
+    ParticleSystem particles(nParticles,initial.size() > 0 ? &initial[0] : nullptr,dt,density);
+    std::vector<float>().swap(initial);
+    particles.enableCounters(counters);
+    if (shmName != "" && !trajectory && !particles.shareFrames(shmName,shmEvery)){
+      return 1;
+    }
+
+    std::unique_ptr<StatsServer> statsServer;
+    if (statsSocket != ""){statsServer.reset(new StatsServer(statsSocket,particles));}
+
+    std::unique_ptr<TrajectoryWriter> recorder;
+    if (recordPath != "" && !trajectory){
+      recorder.reset(new TrajectoryWriter(
+        recordPath,
+        particles.size(),
+        particles.getDt(),
+        particles.getDensity(),
+        particles.getRadius(),
+        recordEvery
+      ));
+      if (!recorder->isOpen()){
+        return 1;
+      }
+    }
+
+    return runHeadless(
+      particles,
+      trajectory.get(),
+      recorder.get(),
+      recordEvery,
+      headlessSteps,
+      snapshotPattern,
+      snapshotEvery,
+      snapshotWidth,
+      snapshotHeight,
+      memoryReport
+    );
+  }
 
   sf::ContextSettings contextSettings;
   contextSettings.depthBits = 24;
@@ -60,14 +400,86 @@ int main(){
 
   glewInit();
 
+  // linked programs are cached here between runs
+  shaderManager().initialise("resources/shaderCache/");
+  gpuTimers().initialise();
+
+  std::unique_ptr<FrameCapture> capture;
+  if (capturePattern != ""){
+    capture.reset(new FrameCapture(capturePattern,resX,resY,captureWorkers));
+    if (!capture->isOpen()){
+      return 1;
+    }
+    if (capture->isRaw()){
+      std::cout << "Capturing " << resX << "x" << resY << " rgb24 to stdout, e.g\n"
+        << "  | ffmpeg -f rawvideo -pix_fmt rgb24 -s " << resX << "x" << resY << " -r 60 -i - out.mp4\n";
+    }
+  }
+
   uint8_t debug = 0;
 
-  ParticleSystem particles(N);
+  // playback draws recorded frames through the same particle renderer
+  ParticleSystem particles(
+    nParticles,
+    initial.size() > 0 ? &initial[0] : nullptr,
+    dt,
+    density
+  );
+  std::vector<float>().swap(initial);
+  particles.enableCounters(counters);
+  if (shmName != "" && !trajectory && !particles.shareFrames(shmName,shmEvery)){
+    return 1;
+  }
+
+  std::unique_ptr<StatsServer> statsServer;
+  if (statsSocket != ""){statsServer.reset(new StatsServer(statsSocket,particles));}
+
+  std::unique_ptr<TrajectoryWriter> recorder;
+  if (recordPath != "" && !trajectory){
+    recorder.reset(new TrajectoryWriter(
+      recordPath,
+      particles.size(),
+      particles.getDt(),
+      particles.getDensity(),
+      particles.getRadius(),
+      recordEvery
+    ));
+    if (!recorder->isOpen()){
+      return 1;
+    }
+  }
+
+  // physics runs flat out on its own thread, the loop below only renders
+  std::unique_ptr<PhysicsThread> physics;
+  if (!trajectory){
+    physics.reset(new PhysicsThread(
+      particles,
+      maxAttractors,
+      maxRepellors,
+      targetFrameTime/subSample,
+      [&recorder,recordEvery](ParticleSystem & p){
+        if (recorder && p.getSteps() % recordEvery == 0){
+          recorder->write(p.getState());
+        }
+      }
+    ));
+    physics->setUnlimited(unlimited);
+  }
+  uint64_t droppedFrames = 0;
+  uint64_t lastSteps = 0;
+  double stepRate = 0.0;
+  SimulationStats lastStats;
+  std::string phaseText = "";
+  std::string memoryText = "";
+  sf::Clock stepRateClock;
+
+  double playhead = 0.0;
+  double playbackSpeed = 1.0;
+  int scrubDirection = 1;
 
   sf::Clock clock;
-  sf::Clock physClock, renderClock;
+  sf::Clock renderClock;
 
-  glm::mat4 defaultProj = glm::ortho(0.0,double(resX),0.0,double(resY),0.1,100.0);
   glm::mat4 textProj = glm::ortho(0.0,double(resX),0.0,double(resY));
 
   // for rendering particles using gl_point instances
@@ -85,13 +497,30 @@ int main(){
 
   Type OD("resources/fonts/","OpenDyslexic-Regular.otf",48);
 
+  // laid out once, only lines that change are redone
+  TextLabel debugLabel(OD,64.0f,resY-64.0f,0.5f);
+  FrameTimeGraph frameGraph(resX-64.0f-160.0f,resY-64.0f-64.0f,160.0f,64.0f,resX,resY);
+  std::vector<double> frameSamples(Telemetry::capacity);
+  TextLabel playbackLabel(OD,64.0f,8.0f,0.5f);
+  TextLabel repellorLabel(OD,64.0f,8.0f,0.5f);
+  repellorLabel.setText("Placeing repellor (R) to cancel");
+  TextLabel attractorLabel(OD,64.0f,8.0f,0.5f);
+  attractorLabel.setText("Placeing attractor (A) to cancel");
+
   OrthoCam camera(resX,resY,glm::vec2(0.0,0.0));
 
   glViewport(0,0,resX,resY);
 
+  // the scene is drawn offscreen at a fraction of the window's resolution
+  // when frames run over, then stretched onto the window under the overlay
+  RenderTarget sceneTarget;
+  ResolutionController resolution(targetFrameTime);
+  float renderScale = 1.0;
+
   // box
-  GLuint boxShader = glCreateProgram();
-  compileShader(boxShader,boxVertexShader,boxFragmentShader);
+  GLuint boxShader = shaderManager().program(boxVertexShader,boxFragmentShader);
+  glUseProgram(boxShader);
+  glUniform3f(shaderManager().location(boxShader,"colour"),1.0,1.0,1.0);
 
   GLuint boxVAO, boxVBO;
   glGenVertexArrays(1,&boxVAO);
@@ -113,16 +542,25 @@ int main(){
 
   bool moving = false;
 
-  double avgCollisionsPerFrame = 0.0;
-
   bool placingAttractor = false;
   bool placingRepellor = false;
   bool pause = false;
 
+  // render on demand while paused
+  uint8_t settle = settleFrames;
+  glm::mat4 lastProj(0.0f);
+  // toys pulse in simulation frames, frozen while paused
+  uint64_t toyFrame = 0;
+
   while (window.isOpen()){
 
+    // nothing has changed for a while, block until something happens
+    bool idle = pause && settle == 0 && !capture;                                 // a capture wants every frame
+    bool slept = idle;
     sf::Event event;
-    while (window.pollEvent(event)){
+    while (idle ? window.waitEvent(event) : window.pollEvent(event)){
+      idle = false;
+      settle = settleFrames;
       if (event.type == sf::Event::Closed){
         return 0;
       }
@@ -135,7 +573,41 @@ int main(){
         debug = !debug;
       }
 
-      if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::A){
+      if (trajectory && event.type == sf::Event::KeyPressed){
+        double last = double(trajectory->nFrames()-1);
+        double jump = event.key.shift ? 10.0 : 1.0;
+        switch (event.key.code){
+          case sf::Keyboard::Left:
+            playhead = std::max(0.0,std::floor(playhead)-jump);
+            scrubDirection = -1;
+            break;
+          case sf::Keyboard::Right:
+            playhead = std::min(last,std::floor(playhead)+jump);
+            scrubDirection = 1;
+            break;
+          case sf::Keyboard::Up:
+            playbackSpeed = std::min(maxPlaybackSpeed,playbackSpeed*2.0);
+            break;
+          case sf::Keyboard::Down:
+            playbackSpeed = std::max(minPlaybackSpeed,playbackSpeed*0.5);
+            break;
+          case sf::Keyboard::Home:
+            playhead = 0.0;
+            break;
+          case sf::Keyboard::End:
+            playhead = last;
+            break;
+          case sf::Keyboard::Space:
+            // restart when asked to play from the end
+            if (pause && playhead >= last){playhead = 0.0;}
+            scrubDirection = 1;
+            break;
+          default:
+            break;
+        }
+      }
+
+      if (!trajectory && event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::A){
         if (placingAttractor){
           placingAttractor = false;
         }
@@ -145,7 +617,7 @@ int main(){
         }
       }
 
-      if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::R){
+      if (!trajectory && event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::R){
         if (placingRepellor){
           placingRepellor = false;
         }
@@ -157,6 +629,28 @@ int main(){
 
       if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Space){
         pause = !pause;
+        if (physics){physics->setPaused(pause);}
+      }
+
+      if (physics && event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::U){
+        physics->setUnlimited(!physics->isUnlimited());
+      }
+
+      if (physics && event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::H){
+        // off, particles per cell, pair tests per cell
+        particles.setHeatmap((particles.getHeatmap()+1) % HEATMAP_MODES);
+      }
+
+      if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::T){
+        // a second press writes out what was recorded
+        if (tracer().isEnabled()){
+          tracer().setEnabled(false);
+          tracer().dump(tracer().getOutput() == "" ? "jerboa.trace.json" : tracer().getOutput());
+        }
+        else{
+          tracer().setEnabled(true);
+          std::cout << "Tracing, T again to write the trace\n";
+        }
       }
 
       if (event.type == sf::Event::MouseWheelScrolled){
@@ -181,13 +675,8 @@ int main(){
         // multiply by inverse of current projection
         glm::vec4 worldPos = camera.screenToWorld(pos.x,pos.y);
 
-        if(!particles.deleteAttratorRepellor(worldPos.x,worldPos.y)){
-          if (placingRepellor && particles.nRepellers() < maxRepellors){
-            particles.addRepeller(worldPos.x,worldPos.y);
-          }
-          else if (placingAttractor && particles.nAttractors() < maxAttractors){
-            particles.addAttractor(worldPos.x,worldPos.y);
-          }
+        if (physics){
+          physics->push(ToyCommand{worldPos.x,worldPos.y,placingAttractor,placingRepellor});
         }
       }
 
@@ -212,84 +701,98 @@ int main(){
 
     }
 
+    if (slept){clock.restart();}                                                  // time asleep is not a slow frame
+
+    glm::mat4 proj = camera.getVP();
+    if (proj != lastProj || particles.needsRedraw()){
+      settle = settleFrames;
+    }
+    lastProj = proj;
+
+    if (pause){
+      if (settle == 0 && !capture){continue;}
+      if (settle > 0){settle--;}
+    }
+    else{
+      toyFrame++;
+    }
+
     window.clear(sf::Color::White);
     glClearColor(1.0f,1.0f,1.0f,1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    avgCollisionsPerFrame = 0.0;
-
-    physClock.restart();
-    if (!pause){
-      particles.step();
+    gpuTimers().beginFrame();                                                     // reads back a frame from latency ago
+    if (physics && stepRateClock.getElapsedTime().asSeconds() >= 0.5){
+      uint64_t steps = physics->steps();
+      stepRate = (steps-lastSteps)/stepRateClock.restart().asSeconds();
+      lastSteps = steps;
+      SimulationStats stats = particles.getStats();
+      phaseText = phaseSummary(stats,lastStats);
+      const CellLoad & load = stats.load;
+      phaseText += "Cells: "+std::to_string(load.occupied)+"/"+std::to_string(load.cells)+
+        " occupied, max "+std::to_string(load.maxOccupancy)+", pair tests "+std::to_string(load.pairTests)+
+        " (max "+std::to_string(load.maxCellPairTests)+"/cell)"+
+        (particles.getHeatmap() == HEATMAP_OCCUPANCY ? " [occupancy]" : "")+
+        (particles.getHeatmap() == HEATMAP_PAIRS ? " [pair tests]" : "")+"\n";
+      lastStats = stats;
+      uint64_t rss, peakRss;
+      processMemory(rss,peakRss);
+      memoryText = "Memory: RSS "+formatBytes(rss)+" (peak "+formatBytes(peakRss)+"), "+
+        std::to_string(int(double(rss)/particles.size()))+" B/particle\n";
     }
-    physDeltas[frameId] = physClock.getElapsedTime().asSeconds();
-    avgCollisionsPerFrame /= double(subSample);
-
     renderClock.restart();
 
-    glm::mat4 proj = camera.getVP();
-
-    particles.setProjection(proj);
-    particles.draw(
-      frameId,
-      camera.getZoomLevel(),
-      resX,
-      resY
-    );
-
-    if (debug){
-      double delta = 0.0;
-      double renderDelta = 0.0;
-      double physDelta = 0.0;
-      for (int n = 0; n < 60; n++){
-        delta += deltas[n];
-        renderDelta += renderDeltas[n];
-        physDelta += physDeltas[n];
-      }
-      delta /= 60.0;
-      renderDelta /= 60.0;
-      physDelta /= 60.0;
-      std::stringstream debugText;
+    uint32_t sceneX = resX, sceneY = resY;
+    if (renderScale < 1.0){
+      sceneX = uint32_t(resX*renderScale);
+      sceneY = uint32_t(resY*renderScale);
+      sceneTarget.resize(sceneX,sceneY);
+      sceneTarget.bind();
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
 
-      sf::Vector2i mouse = sf::Mouse::getPosition(window);
+    // the one per frame camera upload, shared by every world space program
+    shaderManager().setCamera(proj,camera.getZoomLevel(),sceneX);
 
-      float cameraX = camera.getPosition().x;
-      float cameraY = camera.getPosition().y;
-
-      debugText << "Particles: " << N <<
-        "\n" <<
-        "Delta: " << fixedLengthNumber(delta,6) <<
-        " (FPS: " << fixedLengthNumber(1.0/delta,4) << ")" <<
-        "\n" <<
-        "Render/Physics: " << fixedLengthNumber(renderDelta,6) << "/" << fixedLengthNumber(physDelta,6) <<
-        "\n" <<
-        "Mouse (" << fixedLengthNumber(mouse.x,4) << "," << fixedLengthNumber(mouse.y,4) << ")" <<
-        "\n" <<
-        "Camera [world] (" << fixedLengthNumber(cameraX,4) << ", " << fixedLengthNumber(cameraY,4) << ")" << "\n";
+    glm::vec2 visibleLower, visibleUpper;
+    camera.visibleRegion(visibleLower,visibleUpper);
+    particles.setVisibleRegion(visibleLower,visibleUpper);
 
-      textRenderer.renderText(
-        OD,
-        debugText.str(),
-        64.0f,resY-64.0f,
-        0.5f,
-        glm::vec3(0.0f,0.0f,0.0f)
+    if (trajectory){
+      double last = double(trajectory->nFrames()-1);
+      if (!pause){
+        playhead += playbackSpeed;
+        if (playhead >= last){
+          playhead = last;
+          pause = true;
+        }
+      }
+      uint64_t f = uint64_t(playhead);
+      trajectory->prefetch(f,scrubDirection);
+      particles.draw(
+        trajectory->frame(f),
+        trajectory->nParticles(),
+        toyFrame,
+        camera.getZoomLevel(),
+        sceneX,
+        sceneY
       );
     }
-
-    if (placingRepellor || placingAttractor){
-      glUseProgram(boxShader);
-
-      glUniformMatrix4fv(
-        glGetUniformLocation(boxShader,"proj"),
-        1,
-        GL_FALSE,
-        &defaultProj[0][0]
+    else{
+      particles.draw(
+        toyFrame,
+        camera.getZoomLevel(),
+        sceneX,
+        sceneY
       );
+    }
 
-      glUniform3f(
-        glGetUniformLocation(boxShader,"colour"),
-        1.0,1.0,1.0
-      );
+    if (renderScale < 1.0){
+      sceneTarget.blit(resX,resY);
+    }
 
+    if (placingRepellor || placingAttractor){
+      gpuTimers().begin(GPU_BOX);
+      glUseProgram(boxShader);
 
       float height = 64.0/resY;
       float width = 1.25;
@@ -312,41 +815,113 @@ int main(){
       glDrawArrays(GL_TRIANGLES,0,6);
       glBindVertexArray(0);
       glBindTexture(GL_TEXTURE_2D, 0);
+      gpuTimers().end(GPU_BOX);
     }
 
-    if (placingRepellor){
-      textRenderer.renderText(
-        OD,
-        "Placeing repellor (R) to cancel",
-        64.0f,8.0f,
-        0.5f,
-        glm::vec3(1.0f,0.0f,0.0f)
-      );
+    // every label and the graph in one timed pass
+    gpuTimers().begin(GPU_TEXT);
+
+    if (debug){
+      // means hide stutters, the tails are what matter
+      MetricSummary frame = telemetry().summary(Metric::FRAME);
+      // GPU time from a few frames ago against CPU time before the swap
+      MetricSummary gpu = telemetry().summary(Metric::GPU);
+      MetricSummary work = telemetry().summary(Metric::WORK);
+      auto percentiles = [](MetricSummary s){
+        return fixedLengthNumber(s.p50,6)+"/"+fixedLengthNumber(s.p95,6)+"/"+
+          fixedLengthNumber(s.p99,6)+"/"+fixedLengthNumber(s.max,6);
+      };
+      std::stringstream debugText;
+
+      sf::Vector2i mouse = sf::Mouse::getPosition(window);
+
+      float cameraX = camera.getPosition().x;
+      float cameraY = camera.getPosition().y;
+
+      debugText << "Particles: " << particles.getDrawnParticles() << "/" << particles.size() <<
+        (particles.getLodFade() > 0.0 ? " (density field)" : "") <<
+        "\n" <<
+        "FPS: " << fixedLengthNumber(frame.mean > 0.0 ? 1.0/frame.mean : 0.0,4) <<
+        " (p50/p95/p99/max over " << frame.n << ")" <<
+        "\n" <<
+        "Frame: " << percentiles(frame) <<
+        "\n" <<
+        "Render: " << percentiles(telemetry().summary(Metric::RENDER)) <<
+        "\n" <<
+        "Physics: " << percentiles(telemetry().summary(Metric::PHYSICS)) <<
+        "\n" <<
+        "Upload: " << percentiles(telemetry().summary(Metric::UPLOAD)) <<
+        "\n" <<
+        "IO: " << percentiles(telemetry().summary(Metric::IO)) <<
+        "\n" <<
+        "GPU: " << percentiles(gpu) << " (" << (gpu.p95 > work.p95 ? "GPU" : "CPU") << " bound)" <<
+        "\n" <<
+        "GPU p95 particles/toys/box/text: " <<
+        fixedLengthNumber(telemetry().summary(Metric::GPU_PARTICLES).p95,6) << "/" <<
+        fixedLengthNumber(telemetry().summary(Metric::GPU_TOYS).p95,6) << "/" <<
+        fixedLengthNumber(telemetry().summary(Metric::GPU_BOX).p95,6) << "/" <<
+        fixedLengthNumber(telemetry().summary(Metric::GPU_TEXT).p95,6) <<
+        "\n" <<
+        "Steps/s: " << fixedLengthNumber(stepRate,6) << (physics && physics->isUnlimited() ? " (unlimited)" : "") <<
+        "\n" <<
+        phaseText <<
+        "Substeps/Dropped frames: " << (physics ? physics->substeps() : 0) << "/" << droppedFrames <<
+        "\n" <<
+        "Render scale: " << fixedLengthNumber(renderScale,4) <<
+        " (p95 frame/work " << fixedLengthNumber(resolution.frameP95(),6) << "/" << fixedLengthNumber(resolution.workTimeP95(),6) << ")" <<
+        "\n" <<
+        memoryText <<
+        (capture ? "Capture written/dropped: "+std::to_string(capture->written())+"/"+std::to_string(capture->dropped())+"\n" : "") <<
+        "Mouse (" << fixedLengthNumber(mouse.x,4) << "," << fixedLengthNumber(mouse.y,4) << ")" <<
+        "\n" <<
+        "Camera [world] (" << fixedLengthNumber(cameraX,4) << ", " << fixedLengthNumber(cameraY,4) << ")" << "\n";
+
+      debugLabel.setText(debugText.str());
+      textRenderer.renderText(debugLabel,glm::vec3(0.0f,0.0f,0.0f));
+
+      uint64_t n = telemetry().recent(Metric::FRAME,frameSamples.data());
+      frameGraph.draw(frameSamples.data(),n,targetFrameTime);
     }
 
-    if (placingAttractor){
-      textRenderer.renderText(
-        OD,
-        "Placeing attractor (A) to cancel",
-        64.0f,8.0f,
-        0.5f,
-        glm::vec3(0.0f,1.0f,0.0f)
-      );
+    if (trajectory){
+      std::stringstream playbackText;
+      playbackText << "Frame " << uint64_t(playhead) << "/" << trajectory->nFrames()-1 <<
+        " x" << playbackSpeed << (pause ? " (paused)" : "");
+      playbackLabel.setText(playbackText.str());
+      textRenderer.renderText(playbackLabel,glm::vec3(0.0f,0.0f,0.0f));
     }
 
-    window.display();
+    if (placingRepellor){
+      textRenderer.renderText(repellorLabel,glm::vec3(1.0f,0.0f,0.0f));
+    }
 
-    deltas[frameId] = clock.getElapsedTime().asSeconds();
-    renderDeltas[frameId] = renderClock.getElapsedTime().asSeconds();
+    if (placingAttractor){
+      textRenderer.renderText(attractorLabel,glm::vec3(0.0f,1.0f,0.0f));
+    }
+    gpuTimers().end(GPU_TEXT);
 
-    clock.restart();
+    if (capture){capture->capture();}                                             // never waits on this frame
 
-    if (frameId == 60){
-      frameId = 0;
+    telemetry().record(Metric::WORK,renderClock.getElapsedTime().asSeconds());
+    {
+      TraceScope trace("swap");
+      window.display();
     }
-    else{
-      frameId++;
+
+    double delta = clock.getElapsedTime().asSeconds();
+    telemetry().record(Metric::FRAME,delta);
+    // any whole display refreshes beyond the one this frame was due in were missed
+    int missed = int(delta/targetFrameTime+0.5)-1;
+    if (missed > 0){droppedFrames += missed;}
+    telemetry().record(Metric::RENDER,renderClock.getElapsedTime().asSeconds());
+    if (memoryReport){
+      // after the first frame, so the GL buffers are counted too
+      printMemoryReport(std::cout,particles.memory());
+      memoryReport = false;
     }
+    renderScale = resolution.update(telemetry());
+
+    clock.restart();
   }
 
   return 0;
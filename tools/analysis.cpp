@@ -0,0 +1,103 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <chrono>
+#include <functional>
+
+#include <Analysis/observables.cpp>
+
+void printUsage(){
+  std::cout << "Usage: JerboaAnalysis <trajectory> [options]\n"
+    << "  -o <prefix>            output prefix (default: trajectory path)\n"
+    << "  -observables <list>    comma separated from msd,vacf,gr,order,clusters (default: all)\n"
+    << "  -maxLag <n>            longest lag in frames for msd/vacf (default: frames/2)\n"
+    << "  -origins <n>           time origins averaged over for msd/vacf (default: 32)\n"
+    << "  -frameStride <n>       analyse every n-th frame for gr/clusters (default: 1)\n"
+    << "  -rmax <r>              g(r) range in units of particle radius (default: 10)\n"
+    << "  -bins <n>              g(r) bins (default: 200)\n"
+    << "  -contact <f>           cluster cutoff in particle diameters (default: 1)\n"
+    << "  -threads <n>           worker threads (default: all cores)\n"
+    << "  -binary                write binary tables instead of CSV\n";
+}
+
+bool wanted(std::string list, std::string name){
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss,item,',')){
+    if (item == name || item == "all"){return true;}
+  }
+  return false;
+}
+
+int main(int argc, char ** argv){
+
+  if (argc < 2){
+    printUsage();
+    return 1;
+  }
+
+  std::string path = argv[1];
+  std::string prefix = path;
+  std::string observables = "all";
+  int64_t maxLag = -1;
+  uint64_t origins = 32;
+  uint64_t frameStride = 1;
+  float rmax = 10.0;
+  uint64_t bins = 200;
+  float contact = 1.0;
+  unsigned threads = 0;
+  bool binary = false;
+
+  for (int i = 2; i < argc; i++){
+    std::string arg = argv[i];
+    bool hasValue = i+1 < argc;
+    if (arg == "-o" && hasValue){prefix = argv[++i];}
+    else if (arg == "-observables" && hasValue){observables = argv[++i];}
+    else if (arg == "-maxLag" && hasValue){maxLag = std::atoll(argv[++i]);}
+    else if (arg == "-origins" && hasValue){origins = std::max(1ll,std::atoll(argv[++i]));}
+    else if (arg == "-frameStride" && hasValue){frameStride = std::max(1ll,std::atoll(argv[++i]));}
+    else if (arg == "-rmax" && hasValue){rmax = std::atof(argv[++i]);}
+    else if (arg == "-bins" && hasValue){bins = std::max(1ll,std::atoll(argv[++i]));}
+    else if (arg == "-contact" && hasValue){contact = std::atof(argv[++i]);}
+    else if (arg == "-threads" && hasValue){threads = std::max(0,std::atoi(argv[++i]));}
+    else if (arg == "-binary"){binary = true;}
+    else{
+      printUsage();
+      return 1;
+    }
+  }
+
+  TrajectoryReader trajectory(path);
+  if (!trajectory.isOpen()){
+    return 1;
+  }
+
+  uint64_t F = trajectory.nFrames();
+  float radius = trajectory.getHeader().radius;
+  if (maxLag < 0){maxLag = F/2;}
+  uint64_t originStride = std::max(uint64_t(1),(F-std::min(uint64_t(maxLag),F-1))/origins);
+
+  std::cout << path << ": " << trajectory.nParticles() << " particles, " << F << " frames\n";
+
+  std::string extension = binary ? ".bin" : ".csv";
+
+  auto run = [&](std::string name, std::function<Table()> f){
+    if (!wanted(observables,name)){return;}
+    auto tic = std::chrono::steady_clock::now();
+    Table t = f();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now()-tic).count();
+    std::string out = prefix+"_"+name+extension;
+    if (writeTable(t,out,binary)){
+      std::cout << name << " -> " << out << " (" << seconds << " s)\n";
+    }
+  };
+
+  run("msd",[&]{return meanSquaredDisplacement(trajectory,maxLag,originStride,threads);});
+  run("vacf",[&]{return velocityAutocorrelation(trajectory,maxLag,originStride,threads);});
+  run("gr",[&]{return radialDistribution(trajectory,rmax*radius,bins,frameStride,threads);});
+  run("order",[&]{return orientationalOrder(trajectory,threads);});
+  run("clusters",[&]{return clusterSizes(trajectory,contact*2.0*radius,frameStride,threads);});
+
+  return 0;
+}